@@ -0,0 +1,219 @@
+/**
+ * Benchmark harness: generates a synthetic directory, then times the
+ * stages every performance discussion here argues about - read_dir
+ * ingestion, the sort, and a scripted scroll of redraws - in isolation.
+ * Build and run with make bench; see the usage line for the knobs
+ */
+#define FILET_BENCH
+#include "filet.c"
+
+/**
+ * Deterministic xorshift so two runs generate identical trees
+ */
+static uint64_t g_rng = 0x9e3779b97f4a7c15;
+
+static uint64_t
+rng_next(void)
+{
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * One synthetic name: mostly short, every 16th long, every 32nd with
+ * multibyte characters so the width scanner gets exercised too
+ */
+static void
+gen_name(char *out, size_t cap, size_t i)
+{
+    static const char pool[] =
+        "abcdefghijklmnopqrstuvwxyz0123456789_-";
+    size_t len = 4 + rng_next() % 24;
+    if (i % 16 == 0) {
+        len = 100 + rng_next() % 100;
+    }
+
+    size_t at = (size_t)snprintf(out, cap, "%08zx", i); // uniqueness
+    while (at < len && at + 4 < cap) {
+        if (i % 32 == 0 && at % 8 == 0) {
+            memcpy(out + at, "\xe6\xbc\xa2", 3); // a CJK ideograph
+            at += 3;
+        } else {
+            out[at++] = pool[rng_next() % (sizeof(pool) - 1)];
+        }
+    }
+    out[at] = '\0';
+}
+
+/**
+ * Builds a flat directory of n entries with the requested dir and
+ * symlink percentages; everything else is a regular file
+ */
+static int
+gen_tree(char *path, size_t n, unsigned dir_pct, unsigned link_pct)
+{
+    snprintf(
+        path, PATH_MAX, "%s/filet-bench.XXXXXX", getenv_or("TMPDIR", "/tmp"));
+    if (!mkdtemp(path)) {
+        perror("mkdtemp");
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+
+    char name[NAME_MAX + 1];
+    for (size_t i = 0; i < n; ++i) {
+        gen_name(name, sizeof(name), i);
+
+        unsigned roll = (unsigned)(rng_next() % 100);
+        if (roll < dir_pct) {
+            mkdirat(fd, name, 0755);
+        } else if (roll < dir_pct + link_pct) {
+            symlinkat(".", fd, name);
+        } else {
+            int f = openat(fd, name, O_CREAT | O_WRONLY | O_EXCL, 0644);
+            if (f >= 0) {
+                close(f);
+            }
+        }
+    }
+
+    return fd;
+}
+
+int
+main(int argc, char **argv)
+{
+    size_t n          = 100000;
+    unsigned dir_pct  = 10;
+    unsigned link_pct = 5;
+    size_t frames     = 1000;
+
+    if (argc > 1) {
+        n = (size_t)strtoull(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        dir_pct = (unsigned)strtoul(argv[2], NULL, 10);
+    }
+    if (argc > 3) {
+        link_pct = (unsigned)strtoul(argv[3], NULL, 10);
+    }
+    if (n == 0 || dir_pct + link_pct > 100) {
+        fprintf(stderr, "usage: %s [entries] [dir%%] [link%%]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // the renderer needs a size; no tty is involved in the bench, so
+    // anything the streaming paint flushes mid-scan goes nowhere
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0) {
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+    }
+    g_row               = 50;
+    g_col               = 120;
+    g_user_and_hostname = "bench@bench:";
+    update_name_cols();
+    colors_init();
+
+    fprintf(stderr, "generating %zu entries (%u%% dirs, %u%% links)...\n",
+            n, dir_pct, link_pct);
+
+    char *path = malloc(PATH_MAX);
+    if (!path) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    uint64_t t0 = now_ns();
+    int fd      = gen_tree(path, n, dir_pct, link_pct);
+    if (fd < 0) {
+        return EXIT_FAILURE;
+    }
+    uint64_t t_gen = now_ns() - t0;
+
+    // stage 1: full ingestion (getdents stream, classification, sort,
+    // view build), exactly what the fetch path runs
+    size_t sel;
+    size_t y;
+    t0                 = now_ns();
+    struct dirlist *dl = read_dir(fd, path, true, &sel, &y);
+    uint64_t t_scan    = now_ns() - t0;
+
+    // stage 2: the sort alone. read_dir already sorted dl, and timing a
+    // pre-sorted input would flatter the small-bucket cutoff, so push
+    // the same names back in a shuffled order first
+    uint32_t *perm = malloc(dl->n * sizeof(*perm));
+    if (!perm) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < dl->n; ++i) {
+        perm[i] = (uint32_t)i;
+    }
+    for (size_t i = dl->n; i > 1; --i) {
+        size_t j     = rng_next() % i;
+        uint32_t tmp = perm[i - 1];
+        perm[i - 1]  = perm[j];
+        perm[j]      = tmp;
+    }
+
+    struct dirlist shuffled = {0};
+    for (size_t i = 0; i < dl->n; ++i) {
+        uint32_t s = perm[i];
+        dirlist_push(&shuffled, ent_name(dl, s), dl->type[s], dl->flags[s]);
+    }
+    free(perm);
+
+    t0 = now_ns();
+    dirlist_sort(&shuffled);
+    uint64_t t_sort = now_ns() - t0;
+
+    // stage 3: a scripted scroll; every frame moves the cursor so the
+    // diff renderer always has rows to emit. Frames are composed and
+    // dropped - compose cost and bytes, no terminal in the loop
+    uint64_t bytes = 0;
+    t0             = now_ns();
+    for (size_t f = 0; f < frames && dl->nview > 0; ++f) {
+        size_t s = f % dl->nview;
+        redraw(dl, "bench@bench:", path, s, s);
+        bytes += g_frame.len;
+        g_frame.len = 0;
+    }
+    uint64_t t_draw = now_ns() - t0;
+
+    fprintf(stderr, "\n%zu entries, %zu in view\n", dl->n, dl->nview);
+    fprintf(stderr, "  generate: %8.1f ms\n", (double)t_gen / 1e6);
+    fprintf(stderr, "  read_dir: %8.1f ms  %10.0f entries/s\n",
+            (double)t_scan / 1e6, (double)dl->n / ((double)t_scan / 1e9));
+    fprintf(stderr, "  sort:     %8.1f ms  %10.0f entries/s\n",
+            (double)t_sort / 1e6,
+            (double)shuffled.n / ((double)t_sort / 1e9));
+    fprintf(stderr, "  redraw:   %8.1f ms  %10.0f frames/s, %zu bytes\n",
+            (double)t_draw / 1e6,
+            (double)frames / ((double)t_draw / 1e9), (size_t)bytes);
+
+    // tear the tree down with the same walker deletions use
+    int rootfd = open(path, O_RDONLY | O_DIRECTORY);
+    if (rootfd >= 0) {
+        walker_run(rootfd, ".", &g_del_walker_ops, NULL);
+        close(rootfd);
+    }
+    rmdir(path);
+
+    return EXIT_SUCCESS;
+}
@@ -5,353 +5,5776 @@
  * You can obtain one at https://mozilla.org/MPL/2.0/.
  */
 
+#include <ctype.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <dirent.h>
 #include <fcntl.h>
-#include <ftw.h>
 #include <libgen.h>
 #include <limits.h>
+#include <linux/fs.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 #define ENT_ALLOC_NUM 64
+#define DENTS_BUF_SIZE (64 * 1024)
+#define STAT_POOL_NTHREADS 4
+#define STAT_RING_SIZE 4096 // must be a power of two
+#define DIR_CACHE_SIZE 8
+#define WALKER_NTHREADS 8
+#define SIZE_CACHE_SIZE 1024
+#define SIZE_RING_SIZE 256 // must be a power of two
+#define PAGER_RUN_ENTS (128 * 1024) // spill threshold and run length
+#define PAGER_PAGE_ENTS 8192        // entries demand-loaded per page
+#define PAGER_RD_BUF (16 * 1024)    // per-run read buffer during the merge
+#define PREVIEW_CAP (64 * 1024)     // bytes mapped and prefaulted per preview
 
-struct direlement {
-    enum {
-        TYPE_DIR,
-        TYPE_SYML,
-        TYPE_SYML_TO_DIR,
-        TYPE_EXEC,
-        TYPE_NORM,
-    } type;
+#ifdef FILET_INSTRUMENT
 
-    char name[NAME_MAX + 1];
-    bool is_selected;
+/**
+ * Build-time instrumentation (make INSTRUMENT=1): syscall counters,
+ * fetch-stage timers and per-redraw nanoseconds, surfaced in a status
+ * bar overlay and as a histogram on exit. All call sites compile to
+ * nothing in regular builds
+ */
+struct instr {
+    atomic_uint_fast64_t n_getdents; // getdents64 batches
+    atomic_uint_fast64_t n_stat;     // fstatat calls on the fetch paths
+    atomic_uint_fast64_t n_write;    // terminal writes
+    atomic_uint_fast64_t wr_bytes;   // bytes those writes moved
+    atomic_uint_fast64_t scan_ns;    // last scan stage
+    atomic_uint_fast64_t sort_ns;    // last sort/merge stage
+    atomic_uint_fast64_t draw_ns;    // last redraw
+    atomic_uint_fast64_t draws;
+    atomic_uint_fast64_t draw_hist[32]; // log2(ns) buckets
+};
+
+static struct instr g_instr;
+
+static void instr_overlay(void); // needs the renderer, defined there
+
+static uint64_t
+instr_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void
+instr_draw(uint64_t t0)
+{
+    uint64_t ns = instr_now() - t0;
+
+    atomic_store_explicit(&g_instr.draw_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_instr.draws, 1, memory_order_relaxed);
+
+    int b = 0;
+    while (ns > 1 && b < 31) {
+        ns >>= 1;
+        ++b;
+    }
+    atomic_fetch_add_explicit(
+        &g_instr.draw_hist[b], 1, memory_order_relaxed);
+}
+
+static void
+instr_fmt_ns(uint64_t ns, char *out, size_t cap)
+{
+    if (ns < 1000) {
+        snprintf(out, cap, "%lluns", (unsigned long long)ns);
+    } else if (ns < 1000 * 1000) {
+        snprintf(out, cap, "%.1fus", (double)ns / 1e3);
+    } else if (ns < 1000 * 1000 * 1000) {
+        snprintf(out, cap, "%.1fms", (double)ns / 1e6);
+    } else {
+        snprintf(out, cap, "%.1fs", (double)ns / 1e9);
+    }
+}
+
+/**
+ * Exit report: totals plus the redraw latency histogram, one line per
+ * occupied power-of-two bucket
+ */
+static void
+instr_dump(void)
+{
+    fprintf(
+        stderr,
+        "filet instrumentation:\n"
+        "  getdents %llu  stat %llu  write %llu (%llu bytes)\n"
+        "  redraws  %llu\n",
+        (unsigned long long)atomic_load(&g_instr.n_getdents),
+        (unsigned long long)atomic_load(&g_instr.n_stat),
+        (unsigned long long)atomic_load(&g_instr.n_write),
+        (unsigned long long)atomic_load(&g_instr.wr_bytes),
+        (unsigned long long)atomic_load(&g_instr.draws));
+
+    for (int b = 0; b < 32; ++b) {
+        uint64_t count = atomic_load(&g_instr.draw_hist[b]);
+        if (count == 0) {
+            continue;
+        }
+
+        char lo[16];
+        char hi[16];
+        instr_fmt_ns((uint64_t)1 << b, lo, sizeof(lo));
+        instr_fmt_ns(((uint64_t)1 << b) * 2, hi, sizeof(hi));
+        fprintf(
+            stderr, "  %8s - %8s %llu\n", lo, hi,
+            (unsigned long long)count);
+    }
+}
+
+#define INSTR_COUNT(f) \
+    atomic_fetch_add_explicit(&g_instr.f, 1, memory_order_relaxed)
+#define INSTR_ADD(f, n) \
+    atomic_fetch_add_explicit(&g_instr.f, (n), memory_order_relaxed)
+#define INSTR_TIMER(t) uint64_t t = instr_now()
+#define INSTR_STAGE(f, t) \
+    atomic_store_explicit(&g_instr.f, instr_now() - (t), \
+                          memory_order_relaxed)
+#define INSTR_DRAW(t) instr_draw(t)
+#define INSTR_OVERLAY() instr_overlay()
+#define INSTR_INIT() atexit(instr_dump)
+
+#else
+
+#define INSTR_COUNT(f)
+#define INSTR_ADD(f, n)
+#define INSTR_TIMER(t)
+#define INSTR_STAGE(f, t)
+#define INSTR_DRAW(t)
+#define INSTR_OVERLAY()
+#define INSTR_INIT()
+
+#endif
+
+/**
+ * Raw dirent as returned by getdents64. glibc doesn't expose this
+ */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    uint16_t d_reclen;
+    uint8_t d_type;
+    char d_name[];
+};
+
+enum enttype {
+    TYPE_DIR,
+    TYPE_SYML,
+    TYPE_SYML_TO_DIR,
+    TYPE_EXEC,
+    TYPE_NORM,
+};
+
+#define ENT_STAT_DONE 0x2
+#define ENT_HIDDEN 0x4
+#define ENT_SIZE_DONE 0x8
+#define ENT_META_DONE 0x10 // st_mtim (and st_size) captured
+
+/**
+ * A directory listing in structure-of-arrays form. Entry i has its type in
+ * type[i], its flags in flags[i] and its name at arena + name_off[i], so
+ * the hot loops (compare, draw) walk dense arrays instead of striding over
+ * a 264-byte struct per entry
+ */
+struct dirlist {
+    uint32_t *name_off;
+    uint8_t *type;
+    uint8_t *flags;
+    uint64_t *size;  // st_size, or a recursive total for directories
+    uint64_t *mtime; // st_mtim in nanoseconds since the epoch
+    uint64_t *ino;   // inode number, 0 when unknown
+    uint16_t *color; // LS_COLORS suffix match, COLOR_NONE when unmatched
+    uint16_t *dwidth;    // display columns of the whole name
+    uint16_t *dtrunc;    // byte prefix that fits trunc_cols columns
+    uint16_t trunc_cols; // name columns dtrunc was computed for
+    uint16_t wmax;       // widest name seen; removals don't shrink it
+    size_t n;
+    size_t cap;
+
+    char *arena;
+    size_t arena_len;
+    size_t arena_cap;
+
+    // indices of the entries the current view shows, in display order
+    uint32_t *view;
+    size_t nview;
+    size_t view_cap;
+
+    // entry positions ordered by name_off, for mapping an arena offset
+    // back to its entry; rebuilt lazily whenever positions moved
+    uint32_t *by_off;
+    bool by_off_dirty;
 };
 
 static struct termios g_old_termios;
 static int g_row;
 static int g_col;
+static int g_dirfd = -1;
+static uint64_t g_dir_dev; // st_dev of the current directory
+
+static atomic_bool g_del_active;  // a background deletion is running
+static atomic_size_t g_del_files; // files removed so far
+static atomic_size_t g_del_done;  // marked items finished
+static size_t g_del_total;        // marked items queued
+static struct timespec g_del_start;
+
+static atomic_bool g_cp_active;          // a background paste is running
+static atomic_size_t g_cp_files;         // files copied so far
+static atomic_uint_fast64_t g_cp_bytes;  // bytes copied so far
+static atomic_size_t g_cp_done;          // yanked items finished
+static size_t g_cp_total;                // yanked items queued
+static struct timespec g_cp_start;
 
 /**
- * Deletes a file. Can be passed to nftw
+ * Callbacks driving the parallel walker. dir_enter (optional) runs right
+ * after a directory opens, before anything below it - its return value
+ * becomes the directory's tag, handed to the callbacks for its entries
+ * (a tree copy keeps the destination fd there). file runs for every
+ * non-directory entry; dir_done runs once everything below a directory
+ * has been handled, giving depth-first-completion semantics (what a
+ * recursive delete needs) from a parallel traversal
  */
-static int
-delete_file(
-    const char *fpath,
-    const struct stat *sb,
-    int typeflag,
-    struct FTW *ftwbuf)
+struct walker_ops {
+    void *(*dir_enter)(int fd, const char *name, void *parent_tag, void *ud);
+    void (*file)(int dirfd, const char *name, void *tag, void *ud);
+    void (*dir_done)(
+        int parent_fd, const char *name, int fd, void *tag, void *ud);
+};
+
+/**
+ * One directory in flight. The fd opens lazily at scan time and stays
+ * open until all children finished, so fd usage is bounded by the active
+ * frontier instead of the tree size
+ */
+struct walk_dir {
+    struct walk_dir *parent;
+    atomic_int pending; // unfinished children, +1 while unscanned
+    int fd;
+    void *tag; // what dir_enter returned for this directory
+    char name[];
+};
+
+struct walk_deque {
+    struct walk_dir **items;
+    size_t head; // thieves take from here
+    size_t n;    // owners push and pop at the tail
+    size_t cap;
+    pthread_mutex_t mtx;
+};
+
+struct walker_ctx {
+    const struct walker_ops *ops;
+    void *ud;
+    int rootfd;
+    struct walk_deque dq[WALKER_NTHREADS];
+    atomic_size_t inflight; // allocated but not yet finalized dirs
+};
+
+struct walker_worker {
+    struct walker_ctx *ctx;
+    int id;
+};
+
+/**
+ * Queues a directory on the given deque
+ */
+static void
+walker_push(struct walker_ctx *ctx, int id, struct walk_dir *wd)
 {
-    return remove(fpath);
+    struct walk_deque *dq = &ctx->dq[id];
+
+    atomic_fetch_add(&ctx->inflight, 1);
+
+    pthread_mutex_lock(&dq->mtx);
+    if (dq->n == dq->cap) {
+        dq->cap = dq->cap ? dq->cap * 2 : 64;
+        struct walk_dir **items =
+            realloc(dq->items, dq->cap * sizeof(*items));
+        if (!items) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        dq->items = items;
+    }
+    dq->items[dq->n++] = wd;
+    pthread_mutex_unlock(&dq->mtx);
 }
 
 /**
- * Got too used to rust. This falls back to fallback, if name isn't set
+ * Takes the newest entry from the worker's own deque (LIFO keeps the
+ * traversal depth-first-ish and the fd frontier small), or steals the
+ * oldest entry from another worker's deque
  */
-static const char *
-getenv_or(const char *name, const char *fallback)
+static struct walk_dir *
+walker_pop(struct walker_ctx *ctx, int id)
 {
-    const char *res = getenv(name);
-    if (!res) {
-        return fallback;
+    for (int k = 0; k < WALKER_NTHREADS; ++k) {
+        struct walk_deque *dq = &ctx->dq[(id + k) % WALKER_NTHREADS];
+        struct walk_dir *wd   = NULL;
+
+        pthread_mutex_lock(&dq->mtx);
+        if (dq->n > dq->head) {
+            if (k == 0) {
+                wd = dq->items[--dq->n];
+            } else {
+                wd = dq->items[dq->head++];
+            }
+        }
+        pthread_mutex_unlock(&dq->mtx);
+
+        if (wd) {
+            return wd;
+        }
     }
-    return res;
+
+    return NULL;
 }
 
 /**
- * Comparison function for direlements
+ * Drops one reference on a directory; the last one triggers dir_done and
+ * propagates up to the parent
  */
-static int
-direlemcmp(const void *va, const void *vb)
+static void
+walker_release(struct walker_ctx *ctx, struct walk_dir *wd)
+{
+    while (wd && atomic_fetch_sub(&wd->pending, 1) == 1) {
+        struct walk_dir *parent = wd->parent;
+
+        ctx->ops->dir_done(
+            parent ? parent->fd : ctx->rootfd,
+            wd->name,
+            wd->fd,
+            wd->tag,
+            ctx->ud);
+
+        if (wd->fd >= 0) {
+            close(wd->fd);
+        }
+        free(wd);
+        atomic_fetch_sub(&ctx->inflight, 1);
+
+        wd = parent;
+    }
+}
+
+/**
+ * Scans one directory with getdents64, firing file callbacks and queueing
+ * subdirectories
+ */
+static void
+walker_scan(struct walker_ctx *ctx, int id, struct walk_dir *wd)
+{
+    char buf[32 * 1024];
+
+    wd->fd = openat(
+        wd->parent ? wd->parent->fd : ctx->rootfd,
+        wd->name,
+        O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+
+    if (wd->fd >= 0 && ctx->ops->dir_enter) {
+        wd->tag = ctx->ops->dir_enter(
+            wd->fd,
+            wd->name,
+            wd->parent ? wd->parent->tag : NULL,
+            ctx->ud);
+    }
+
+    if (wd->fd >= 0) {
+        for (;;) {
+            ssize_t nread = syscall(SYS_getdents64, wd->fd, buf, sizeof(buf));
+            if (nread <= 0) {
+                break;
+            }
+
+            for (ssize_t pos = 0; pos < nread;) {
+                struct linux_dirent64 *ent =
+                    (struct linux_dirent64 *)(buf + pos);
+                const char *name = ent->d_name;
+                uint8_t d_type   = ent->d_type;
+
+                pos += ent->d_reclen;
+
+                if (name[0] == '.' &&
+                    (name[1] == '\0' ||
+                     (name[1] == '.' && name[2] == '\0'))) {
+                    continue;
+                }
+
+                if (d_type == DT_UNKNOWN) {
+                    struct stat sb;
+                    if (fstatat(wd->fd, name, &sb, AT_SYMLINK_NOFOLLOW) ==
+                            0 &&
+                        S_ISDIR(sb.st_mode)) {
+                        d_type = DT_DIR;
+                    }
+                }
+
+                if (d_type == DT_DIR) {
+                    struct walk_dir *child =
+                        malloc(sizeof(*child) + strlen(name) + 1);
+                    if (!child) {
+                        continue; // skip on OOM rather than abort the walk
+                    }
+                    child->parent = wd;
+                    child->fd     = -1;
+                    child->tag    = NULL;
+                    atomic_init(&child->pending, 1);
+                    strcpy(child->name, name);
+
+                    atomic_fetch_add(&wd->pending, 1);
+                    walker_push(ctx, id, child);
+                } else {
+                    ctx->ops->file(wd->fd, name, wd->tag, ctx->ud);
+                }
+            }
+        }
+    }
+
+    walker_release(ctx, wd); // drop the scan reference
+}
+
+/**
+ * Walker worker thread: own work first, then steal, quit when the whole
+ * traversal drained
+ */
+static void *
+walker_thread(void *arg)
+{
+    struct walker_worker *w = arg;
+
+    for (;;) {
+        struct walk_dir *wd = walker_pop(w->ctx, w->id);
+        if (!wd) {
+            if (atomic_load(&w->ctx->inflight) == 0) {
+                break;
+            }
+            struct timespec ts = {0, 1000000}; // 1ms
+            nanosleep(&ts, NULL);
+            continue;
+        }
+
+        walker_scan(w->ctx, w->id, wd);
+    }
+
+    return NULL;
+}
+
+/**
+ * Walks the directory name under rootfd with a pool of worker threads.
+ * Blocks until the traversal finished; meant to be called from a
+ * background thread, not the UI loop
+ */
+static void
+walker_run(int rootfd, const char *name, const struct walker_ops *ops,
+           void *ud)
+{
+    struct walker_ctx *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) {
+        return;
+    }
+
+    ctx->ops    = ops;
+    ctx->ud     = ud;
+    ctx->rootfd = rootfd;
+    for (int i = 0; i < WALKER_NTHREADS; ++i) {
+        pthread_mutex_init(&ctx->dq[i].mtx, NULL);
+    }
+
+    struct walk_dir *root = malloc(sizeof(*root) + strlen(name) + 1);
+    if (!root) {
+        free(ctx);
+        return;
+    }
+    root->parent = NULL;
+    root->fd     = -1;
+    root->tag    = NULL;
+    atomic_init(&root->pending, 1);
+    strcpy(root->name, name);
+    walker_push(ctx, 0, root);
+
+    pthread_t threads[WALKER_NTHREADS];
+    struct walker_worker workers[WALKER_NTHREADS];
+    int started = 0;
+    for (int i = 0; i < WALKER_NTHREADS; ++i) {
+        workers[i] = (struct walker_worker){.ctx = ctx, .id = i};
+        if (pthread_create(&threads[i], NULL, walker_thread, &workers[i]) !=
+            0) {
+            break;
+        }
+        ++started;
+    }
+
+    if (started == 0) {
+        // no threads at all: degrade to walking on the calling thread
+        struct walker_worker self = {.ctx = ctx, .id = 0};
+        walker_thread(&self);
+    }
+
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < WALKER_NTHREADS; ++i) {
+        pthread_mutex_destroy(&ctx->dq[i].mtx);
+        free(ctx->dq[i].items);
+    }
+    free(ctx);
+}
+
+/**
+ * Walker callbacks for deletion: unlink files as they're found, remove
+ * each directory once it's empty
+ */
+static void
+del_walk_file(int dirfd, const char *name, void *tag, void *ud)
+{
+    (void)tag;
+    (void)ud;
+    if (unlinkat(dirfd, name, 0) == 0) {
+        atomic_fetch_add(&g_del_files, 1);
+    }
+}
+
+static void
+del_walk_dir_done(int parent_fd, const char *name, int fd, void *tag, void *ud)
+{
+    (void)fd;
+    (void)tag;
+    (void)ud;
+    if (unlinkat(parent_fd, name, AT_REMOVEDIR) == 0) {
+        atomic_fetch_add(&g_del_files, 1);
+    }
+}
+
+static const struct walker_ops g_del_walker_ops = {
+    .file     = del_walk_file,
+    .dir_done = del_walk_dir_done,
+};
+
+/**
+ * One marked entry queued for background deletion
+ */
+struct del_item {
+    uint8_t type;
+    char name[NAME_MAX + 1];
+};
+
+struct del_job {
+    char dir[PATH_MAX];
+    struct del_item *items;
+    size_t n;
+};
+
+/**
+ * Background deletion worker. Trees go through the parallel walker, flat
+ * files through plain unlinkat; the watcher on the current directory
+ * makes finished rows disappear from the listing as their events come in
+ */
+static void *
+delete_worker(void *arg)
+{
+    struct del_job *job = arg;
+
+    int jobfd = open(job->dir, O_RDONLY | O_DIRECTORY);
+
+    for (size_t i = 0; i < job->n; ++i) {
+        if (jobfd < 0) {
+            break;
+        }
+
+        if (job->items[i].type == TYPE_DIR) {
+            walker_run(jobfd, job->items[i].name, &g_del_walker_ops, NULL);
+        } else if (unlinkat(jobfd, job->items[i].name, 0) == 0) {
+            atomic_fetch_add(&g_del_files, 1);
+        }
+
+        atomic_fetch_add(&g_del_done, 1);
+    }
+
+    if (jobfd >= 0) {
+        close(jobfd);
+    }
+    free(job->items);
+    free(job);
+    atomic_store(&g_del_active, false);
+
+    return NULL;
+}
+
+/**
+ * One yanked entry, either on the clipboard or queued for a paste
+ */
+struct cp_item {
+    uint8_t type;
+    char name[NAME_MAX + 1];
+};
+
+// the clipboard: entries yanked with 'y', relative to their dir's fd
+static int g_yank_fd = -1;
+static struct cp_item *g_yank_items;
+static size_t g_yank_n;
+
+/**
+ * One paste, handed to the copy worker
+ */
+struct cp_job {
+    int src_fd;
+    int dst_fd;
+    bool move;
+    struct cp_item *items;
+    size_t n;
+};
+
+/**
+ * Copies one regular file (or symlink) between directory fds. Tries a
+ * reflink first - free on btrfs and XFS - then copy_file_range, which
+ * stays in the kernel and offloads to the filesystem where it can, then
+ * sendfile for filesystems that support neither. Existing destination
+ * entries are never overwritten. Returns true only when the whole file
+ * verifiably made it across - a move must not delete anything less
+ */
+static bool
+cp_copy_file(int src_fd, int dst_fd, const char *name)
+{
+    int in = openat(src_fd, name, O_RDONLY | O_NOFOLLOW);
+    if (in < 0) {
+        if (errno == ELOOP) {
+            // a symlink: recreate it instead of copying through it
+            char target[PATH_MAX];
+            ssize_t len =
+                readlinkat(src_fd, name, target, sizeof(target) - 1);
+            if (len > 0) {
+                target[len] = '\0';
+                if (symlinkat(target, dst_fd, name) == 0) {
+                    atomic_fetch_add(&g_cp_files, 1);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(in, &sb) < 0 || !S_ISREG(sb.st_mode)) {
+        close(in);
+        return false;
+    }
+
+    int out = openat(
+        dst_fd,
+        name,
+        O_WRONLY | O_CREAT | O_EXCL,
+        sb.st_mode & 07777);
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+
+    bool ok = false;
+
+#ifdef FICLONE
+    if (ioctl(out, FICLONE, in) == 0) {
+        atomic_fetch_add(&g_cp_bytes, (uint64_t)sb.st_size);
+        ok = true;
+        goto done;
+    }
+#endif
+
+    for (;;) {
+        ssize_t n = syscall(
+            SYS_copy_file_range, in, NULL, out, NULL, (size_t)1 << 30, 0);
+        if (n == 0) {
+            ok = true; // hit EOF, so everything got written
+            goto done;
+        }
+        if (n < 0) {
+            break; // EXDEV/EINVAL/ENOSYS: let sendfile pick up from here
+        }
+        atomic_fetch_add(&g_cp_bytes, (uint64_t)n);
+    }
+
+    for (;;) {
+        ssize_t n = sendfile(out, in, NULL, (size_t)1 << 30);
+        if (n == 0) {
+            ok = true;
+            break;
+        }
+        if (n < 0) {
+            break; // a mid-copy error leaves the file unverified
+        }
+        atomic_fetch_add(&g_cp_bytes, (uint64_t)n);
+    }
+
+done:
+    if (ok) {
+        atomic_fetch_add(&g_cp_files, 1);
+    }
+    close(in);
+    close(out);
+    return ok;
+}
+
+/**
+ * Walker callbacks for a tree copy. dir_enter mirrors the directory on
+ * the destination side and keeps the new fd in the tag (offset by one so
+ * NULL stays "couldn't create it"); files then copy straight between the
+ * two fds. An existing destination directory is merged into. Any failure
+ * anywhere in the tree raises the failed flag, which a move checks
+ * before it lets the delete walker loose on the source
+ */
+struct cp_walk {
+    int dst_root;
+    atomic_bool failed;
+};
+
+static void *
+cp_walk_dir_enter(int fd, const char *name, void *parent_tag, void *ud)
 {
-    const struct direlement *a = va;
-    const struct direlement *b = vb;
+    struct cp_walk *cw = ud;
+    int dst_parent =
+        parent_tag ? (int)(intptr_t)parent_tag - 1 : cw->dst_root;
+
+    struct stat sb;
+    mode_t mode = fstat(fd, &sb) == 0 ? sb.st_mode & 07777 : 0755;
+
+    if (mkdirat(dst_parent, name, mode) < 0 && errno != EEXIST) {
+        atomic_store(&cw->failed, true);
+        return NULL;
+    }
+
+    int dst = openat(dst_parent, name, O_RDONLY | O_DIRECTORY);
+    if (dst < 0) {
+        atomic_store(&cw->failed, true);
+        return NULL;
+    }
+
+    return (void *)(intptr_t)(dst + 1);
+}
+
+static void
+cp_walk_file(int dirfd, const char *name, void *tag, void *ud)
+{
+    struct cp_walk *cw = ud;
+    if (!tag || !cp_copy_file(dirfd, (int)(intptr_t)tag - 1, name)) {
+        atomic_store(&cw->failed, true);
+    }
+}
+
+static void
+cp_walk_dir_done(int parent_fd, const char *name, int fd, void *tag, void *ud)
+{
+    (void)parent_fd;
+    (void)name;
+    (void)fd;
+    (void)ud;
+    if (tag) {
+        close((int)(intptr_t)tag - 1);
+    }
+}
+
+static const struct walker_ops g_cp_walker_ops = {
+    .dir_enter = cp_walk_dir_enter,
+    .file      = cp_walk_file,
+    .dir_done  = cp_walk_dir_done,
+};
+
+/**
+ * Background paste worker. Moves try a plain renameat first and only
+ * fall back to copy-and-delete across filesystems; tree copies fan out
+ * through the parallel walker. The delete half of a move only runs for
+ * items whose copy reported full success - a collision or a mid-copy
+ * error leaves the source untouched
+ */
+static void *
+cp_worker(void *arg)
+{
+    struct cp_job *job = arg;
+
+    for (size_t i = 0; i < job->n; ++i) {
+        const char *name = job->items[i].name;
+
+        if (job->move &&
+            renameat(job->src_fd, name, job->dst_fd, name) == 0) {
+            atomic_fetch_add(&g_cp_files, 1);
+            atomic_fetch_add(&g_cp_done, 1);
+            continue;
+        }
+
+        if (job->items[i].type == TYPE_DIR) {
+            struct cp_walk cw = {.dst_root = job->dst_fd};
+            atomic_init(&cw.failed, false);
+            walker_run(job->src_fd, name, &g_cp_walker_ops, &cw);
+            if (job->move && !atomic_load(&cw.failed)) {
+                walker_run(job->src_fd, name, &g_del_walker_ops, NULL);
+            }
+        } else {
+            bool copied = cp_copy_file(job->src_fd, job->dst_fd, name);
+            if (job->move && copied) {
+                unlinkat(job->src_fd, name, 0);
+            }
+        }
+
+        atomic_fetch_add(&g_cp_done, 1);
+    }
+
+    close(job->src_fd);
+    close(job->dst_fd);
+    free(job->items);
+    free(job);
+    atomic_store(&g_cp_active, false);
+
+    return NULL;
+}
+
+/**
+ * Got too used to rust. This falls back to fallback, if name isn't set
+ */
+static const char *
+getenv_or(const char *name, const char *fallback)
+{
+    const char *res = getenv(name);
+    if (!res) {
+        return fallback;
+    }
+    return res;
+}
+
+#define COLOR_NONE 0xffff
+
+/**
+ * One state of the LS_COLORS suffix automaton. child[c] is the state
+ * reached by reading byte c (0 = no transition, the root is never a
+ * child), color the escape sequence finishing here (arena offset)
+ */
+struct color_node {
+    uint16_t child[256];
+    uint16_t color;
+};
+
+static struct color_node *g_color_nodes; // node 0 is the root
+static size_t g_color_nnodes;
+static size_t g_color_ncap;
+static char *g_color_arena; // pre-rendered "\033[0;...m" sequences
+static size_t g_color_len;
+static size_t g_color_cap;
+static bool g_colors_on; // LS_COLORS was set and parsed
+
+static uint16_t g_color_di = COLOR_NONE; // directory
+static uint16_t g_color_ln = COLOR_NONE; // symlink
+static uint16_t g_color_ex = COLOR_NONE; // executable
+static uint16_t g_color_fi = COLOR_NONE; // plain file
+
+/**
+ * Renders one LS_COLORS value into a complete escape sequence and interns
+ * it. The leading 0; resets whatever attributes the previous row left on
+ */
+static uint16_t
+color_intern(const char *val, size_t len)
+{
+    size_t need = len + 6; // \033 [ 0 ; ... m NUL
+
+    if (g_color_len + need > COLOR_NONE) {
+        return COLOR_NONE; // absurd LS_COLORS, drop the rest
+    }
+
+    if (g_color_len + need > g_color_cap) {
+        g_color_cap = g_color_cap ? g_color_cap * 2 : 512;
+        while (g_color_len + need > g_color_cap) {
+            g_color_cap *= 2;
+        }
+
+        char *arena = realloc(g_color_arena, g_color_cap);
+        if (!arena) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        g_color_arena = arena;
+    }
+
+    uint16_t off = (uint16_t)g_color_len;
+    g_color_len += (size_t)snprintf(
+        g_color_arena + g_color_len, need, "\033[0;%.*sm", (int)len, val);
+    ++g_color_len; // keep the NUL
+
+    return off;
+}
+
+static uint16_t
+color_node_new(void)
+{
+    if (g_color_nnodes == 0xffff) {
+        return 0; // absurd LS_COLORS, reuse the root over adding states
+    }
+
+    if (g_color_nnodes == g_color_ncap) {
+        g_color_ncap = g_color_ncap ? g_color_ncap * 2 : 64;
+
+        struct color_node *nodes =
+            realloc(g_color_nodes, g_color_ncap * sizeof(*nodes));
+        if (!nodes) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        g_color_nodes = nodes;
+    }
+
+    struct color_node *node = &g_color_nodes[g_color_nnodes];
+    memset(node->child, 0, sizeof(node->child));
+    node->color = COLOR_NONE;
+
+    return (uint16_t)g_color_nnodes++;
+}
+
+/**
+ * Adds one *suffix pattern to the automaton, walking the suffix from its
+ * last byte towards the star
+ */
+static void
+color_add_suffix(const char *suffix, size_t len, uint16_t color)
+{
+    uint16_t node = 0;
+
+    while (len > 0) {
+        unsigned char c = (unsigned char)suffix[--len];
+        uint16_t next   = g_color_nodes[node].child[c];
+        if (next == 0) {
+            next = color_node_new();
+            if (next == 0) {
+                return; // out of states
+            }
+            g_color_nodes[node].child[c] = next;
+        }
+        node = next;
+    }
+
+    if (node != 0) {
+        g_color_nodes[node].color = color;
+    }
+}
+
+/**
+ * Parses LS_COLORS once at startup. Type codes we can honor (di, ln, ex,
+ * fi) become the per-type defaults, *suffix patterns go into the reversed
+ * suffix automaton; everything else (globs, device/pipe codes) is
+ * ignored. Without LS_COLORS the built-in palette stays in effect
+ */
+static void
+colors_init(void)
+{
+    const char *env = getenv("LS_COLORS");
+    if (!env || *env == '\0') {
+        return;
+    }
+
+    g_colors_on = true;
+    color_node_new(); // the root
+
+    for (const char *p = env; *p != '\0';) {
+        const char *field = p;
+        while (*p != '\0' && *p != ':') {
+            ++p;
+        }
+        size_t flen = (size_t)(p - field);
+        if (*p == ':') {
+            ++p;
+        }
+
+        const char *eq = memchr(field, '=', flen);
+        if (!eq || eq == field) {
+            continue;
+        }
+
+        size_t klen       = (size_t)(eq - field);
+        const char *val   = eq + 1;
+        size_t vlen       = flen - klen - 1;
+        if (vlen == 0) {
+            continue;
+        }
+
+        if (field[0] == '*' && klen > 1) {
+            color_add_suffix(field + 1, klen - 1, color_intern(val, vlen));
+        } else if (klen == 2 && memcmp(field, "di", 2) == 0) {
+            g_color_di = color_intern(val, vlen);
+        } else if (klen == 2 && memcmp(field, "ln", 2) == 0) {
+            g_color_ln = color_intern(val, vlen);
+        } else if (klen == 2 && memcmp(field, "ex", 2) == 0) {
+            g_color_ex = color_intern(val, vlen);
+        } else if (klen == 2 && memcmp(field, "fi", 2) == 0) {
+            g_color_fi = color_intern(val, vlen);
+        }
+    }
+}
+
+/**
+ * Longest-suffix color for a name: walk the name backwards through the
+ * automaton, remembering the last accepting state. Stops at the first
+ * byte with no transition, so the cost is the matched suffix, not the
+ * name. This runs once per entry at ingest; draws reuse the result
+ */
+static uint16_t
+color_suffix(const char *name, size_t len)
+{
+    if (!g_colors_on || g_color_nnodes == 0) {
+        return COLOR_NONE;
+    }
+
+    uint16_t best = COLOR_NONE;
+    uint16_t node = 0;
+
+    while (len > 0) {
+        uint16_t next = g_color_nodes[node].child[(unsigned char)name[--len]];
+        if (next == 0) {
+            break;
+        }
+
+        node = next;
+        if (g_color_nodes[node].color != COLOR_NONE) {
+            best = g_color_nodes[node].color;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * Name of entry i
+ */
+static const char *
+ent_name(const struct dirlist *dl, size_t i)
+{
+    return dl->arena + dl->name_off[i];
+}
+
+static int g_name_cols; // columns left for names, tracks the term size
+
+struct cp_range {
+    uint32_t lo;
+    uint32_t hi;
+};
+
+/**
+ * Condensed zero-width list: the common combining blocks, joiners and
+ * variation selectors. Exotic scripts missing here cost one column of
+ * slack, never corruption
+ */
+static const struct cp_range g_zero_width[] = {
+    { 0x0300, 0x036f },
+    { 0x0483, 0x0489 },
+    { 0x0591, 0x05c7 },
+    { 0x0610, 0x061a },
+    { 0x064b, 0x065f },
+    { 0x06d6, 0x06dc },
+    { 0x0e31, 0x0e31 },
+    { 0x0e34, 0x0e3a },
+    { 0x0e47, 0x0e4e },
+    { 0x1ab0, 0x1aff },
+    { 0x1dc0, 0x1dff },
+    { 0x200b, 0x200f },
+    { 0x202a, 0x202e },
+    { 0x20d0, 0x20ff },
+    { 0xfe00, 0xfe0f },
+    { 0xfe20, 0xfe2f },
+};
+
+/**
+ * Double-width ranges: CJK, Hangul, fullwidth forms and emoji
+ */
+static const struct cp_range g_double_width[] = {
+    { 0x1100, 0x115f },
+    { 0x2329, 0x232a },
+    { 0x2e80, 0x303e },
+    { 0x3041, 0x33ff },
+    { 0x3400, 0x4dbf },
+    { 0x4e00, 0x9fff },
+    { 0xa000, 0xa4cf },
+    { 0xa960, 0xa97f },
+    { 0xac00, 0xd7a3 },
+    { 0xf900, 0xfaff },
+    { 0xfe10, 0xfe19 },
+    { 0xfe30, 0xfe52 },
+    { 0xfe54, 0xfe66 },
+    { 0xfe68, 0xfe6b },
+    { 0xff00, 0xff60 },
+    { 0xffe0, 0xffe6 },
+    { 0x1f300, 0x1f64f },
+    { 0x1f680, 0x1f6ff },
+    { 0x1f900, 0x1faff },
+    { 0x20000, 0x2fffd },
+    { 0x30000, 0x3fffd },
+};
+
+static bool
+cp_in(const struct cp_range *ranges, size_t n, uint32_t cp)
+{
+    size_t lo = 0;
+    size_t hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cp < ranges[mid].lo) {
+            hi = mid;
+        } else if (cp > ranges[mid].hi) {
+            lo = mid + 1;
+        } else {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int
+cp_width(uint32_t cp)
+{
+    if (cp < 0x80) {
+        return 1;
+    }
+    if (cp_in(g_zero_width, sizeof(g_zero_width) / sizeof(*g_zero_width),
+              cp)) {
+        return 0;
+    }
+    if (cp_in(g_double_width, sizeof(g_double_width) / sizeof(*g_double_width),
+              cp)) {
+        return 2;
+    }
+    return 1;
+}
+
+/**
+ * Decodes one UTF-8 sequence, returning the bytes consumed. Invalid or
+ * truncated input decodes as one replacement byte, so a name made of
+ * garbage still measures and renders byte by byte
+ */
+static size_t
+utf8_decode(const char *s, size_t len, uint32_t *cp)
+{
+    const unsigned char *u = (const unsigned char *)s;
+    size_t need;
+    uint32_t c;
+
+    if (u[0] < 0x80) {
+        *cp = u[0];
+        return 1;
+    } else if ((u[0] & 0xe0) == 0xc0) {
+        need = 2;
+        c    = u[0] & 0x1f;
+    } else if ((u[0] & 0xf0) == 0xe0) {
+        need = 3;
+        c    = u[0] & 0x0f;
+    } else if ((u[0] & 0xf8) == 0xf0) {
+        need = 4;
+        c    = u[0] & 0x07;
+    } else {
+        *cp = 0xfffd;
+        return 1;
+    }
+
+    if (len < need) {
+        *cp = 0xfffd;
+        return 1;
+    }
+
+    for (size_t i = 1; i < need; ++i) {
+        if ((u[i] & 0xc0) != 0x80) {
+            *cp = 0xfffd;
+            return 1;
+        }
+        c = c << 6 | (u[i] & 0x3f);
+    }
+
+    *cp = c;
+    return need;
+}
+
+/**
+ * Measures a name once: total display columns, and the byte prefix that
+ * fits cols columns without splitting a wide character. Pure ASCII takes
+ * the one-byte path through the decoder every iteration, so the common
+ * case stays a tight loop
+ */
+static void
+utf8_measure(
+    const char *name,
+    size_t len,
+    size_t cols,
+    uint16_t *width,
+    uint16_t *fit)
+{
+    size_t w  = 0;
+    size_t at = 0;
+    size_t fb = 0;
+
+    while (at < len) {
+        uint32_t cp;
+        at += utf8_decode(name + at, len - at, &cp);
+        w += (size_t)cp_width(cp);
+        if (w <= cols) {
+            fb = at;
+        }
+    }
+
+    *width = w < 0xffff ? (uint16_t)w : 0xffff;
+    *fit   = (uint16_t)fb;
+}
+
+/**
+ * Recomputes every truncation point for the current name columns. Runs
+ * only when the terminal width or the size column changes; entries whose
+ * full width already fits skip the rescan
+ */
+static void
+dirlist_retrunc(struct dirlist *dl)
+{
+    for (size_t i = 0; i < dl->n; ++i) {
+        const char *name = ent_name(dl, i);
+        size_t len       = strlen(name);
+
+        if (dl->dwidth[i] <= (uint16_t)g_name_cols) {
+            dl->dtrunc[i] = (uint16_t)len;
+        } else {
+            utf8_measure(
+                name,
+                len,
+                (size_t)g_name_cols,
+                &dl->dwidth[i],
+                &dl->dtrunc[i]);
+        }
+    }
+
+    dl->trunc_cols = (uint16_t)g_name_cols;
+}
+
+/**
+ * Empties a listing without giving its buffers back
+ */
+static void
+dirlist_clear(struct dirlist *dl)
+{
+    dl->n         = 0;
+    dl->arena_len = 0;
+    dl->wmax      = 0;
+}
+
+/**
+ * Appends one entry, growing the arrays and the name arena geometrically
+ */
+static void
+dirlist_push(struct dirlist *dl, const char *name, uint8_t type, uint8_t flags)
+{
+    size_t len = strlen(name) + 1;
+
+    if (dl->n == dl->cap) {
+        dl->cap = dl->cap ? dl->cap * 2 : ENT_ALLOC_NUM;
+
+        uint32_t *off   = realloc(dl->name_off, dl->cap * sizeof(*off));
+        uint8_t *type_  = realloc(dl->type, dl->cap * sizeof(*type_));
+        uint8_t *flags_ = realloc(dl->flags, dl->cap * sizeof(*flags_));
+        uint64_t *size  = realloc(dl->size, dl->cap * sizeof(*size));
+        uint64_t *mtime = realloc(dl->mtime, dl->cap * sizeof(*mtime));
+        uint64_t *ino   = realloc(dl->ino, dl->cap * sizeof(*ino));
+        uint16_t *color = realloc(dl->color, dl->cap * sizeof(*color));
+        uint16_t *dwidth = realloc(dl->dwidth, dl->cap * sizeof(*dwidth));
+        uint16_t *dtrunc = realloc(dl->dtrunc, dl->cap * sizeof(*dtrunc));
+        if (!off || !type_ || !flags_ || !size || !mtime || !ino || !color ||
+            !dwidth || !dtrunc) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        dl->name_off = off;
+        dl->type     = type_;
+        dl->flags    = flags_;
+        dl->size     = size;
+        dl->mtime    = mtime;
+        dl->ino      = ino;
+        dl->color    = color;
+        dl->dwidth   = dwidth;
+        dl->dtrunc   = dtrunc;
+    }
+
+    if (dl->arena_len + len > dl->arena_cap) {
+        size_t cap = dl->arena_cap ? dl->arena_cap * 2 : 4096;
+        while (dl->arena_len + len > cap) {
+            cap *= 2;
+        }
+
+        char *arena = realloc(dl->arena, cap);
+        if (!arena) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        dl->arena     = arena;
+        dl->arena_cap = cap;
+    }
+
+    dl->name_off[dl->n] = (uint32_t)dl->arena_len;
+    memcpy(dl->arena + dl->arena_len, name, len);
+    dl->arena_len += len;
+
+    dl->type[dl->n]  = type;
+    dl->flags[dl->n] = flags;
+    dl->size[dl->n]  = 0;
+    dl->mtime[dl->n] = 0;
+    dl->ino[dl->n]   = 0;
+    dl->color[dl->n] = color_suffix(name, len - 1);
+    utf8_measure(
+        name,
+        len - 1,
+        (size_t)g_name_cols,
+        &dl->dwidth[dl->n],
+        &dl->dtrunc[dl->n]);
+    if (dl->dwidth[dl->n] > dl->wmax) {
+        dl->wmax = dl->dwidth[dl->n];
+    }
+    if (dl->n == 0) {
+        dl->trunc_cols = (uint16_t)g_name_cols;
+    }
+    ++dl->n;
+    dl->by_off_dirty = true;
+}
+
+enum sortmode {
+    SORT_NAME,
+    SORT_MTIME, // newest first
+    SORT_SIZE,  // largest first
+};
+
+static const struct dirlist *g_sort_dl; // listing under sort
+static bool g_natural_sort;             // compare digit runs numerically
+static enum sortmode g_sort_mode;       // active sort criterion
+static bool g_sort_reverse;             // invert order within each group
+
+/**
+ * One precomputed sort key: dir bit plus leading name bytes packed into a
+ * u64 so the radix passes never touch the arena
+ */
+struct sortkey {
+    uint64_t key;
+    uint32_t idx;
+};
+
+/**
+ * strcmp variant that compares runs of digits by value, so "foo9" sorts
+ * before "foo10". A digit run against a non-digit compares as smaller,
+ * matching the radix key below, which encodes runs as marker bytes that
+ * order before everything printable - the binary searches over a
+ * key-sorted listing rely on both agreeing
+ */
+static int
+natcmp(const char *sa, const char *sb)
+{
+    const unsigned char *a = (const unsigned char *)sa;
+    const unsigned char *b = (const unsigned char *)sb;
+
+    while (*a && *b) {
+        if (isdigit(*a) && isdigit(*b)) {
+            while (*a == '0' && isdigit(a[1])) {
+                ++a;
+            }
+            while (*b == '0' && isdigit(b[1])) {
+                ++b;
+            }
+
+            size_t la = 0;
+            size_t lb = 0;
+            while (isdigit(a[la])) {
+                ++la;
+            }
+            while (isdigit(b[lb])) {
+                ++lb;
+            }
+
+            if (la != lb) {
+                return la < lb ? -1 : 1;
+            }
+
+            int cmp = memcmp(a, b, la);
+            if (cmp != 0) {
+                return cmp;
+            }
+
+            a += la;
+            b += lb;
+        } else if (isdigit(*a) != isdigit(*b)) {
+            return isdigit(*a) ? -1 : 1;
+        } else {
+            if (*a != *b) {
+                return *a < *b ? -1 : 1;
+            }
+            ++a;
+            ++b;
+        }
+    }
+
+    return (*a > *b) - (*a < *b);
+}
+
+/**
+ * Builds the radix key for entry i: bit 63 clear for dirs (so they always
+ * come first), then a 63-bit payload. For name order the payload holds up
+ * to seven name bytes; in natural mode a digit run is encoded as a length
+ * marker byte followed by its leading digits, which makes shorter numbers
+ * order before longer ones byte-wise. For mtime and size order the payload
+ * is the complemented cached value, so larger sorts first. Reverse order
+ * complements the payload once more
+ */
+static uint64_t
+sort_key(const struct dirlist *dl, uint32_t i)
+{
+    const unsigned char *name = (const unsigned char *)ent_name(dl, i);
+    bool is_dir = dl->type[i] == TYPE_DIR || dl->type[i] == TYPE_SYML_TO_DIR;
+
+    uint64_t dirbit = is_dir ? 0 : (uint64_t)1 << 63;
+
+    if (g_sort_mode != SORT_NAME) {
+        uint64_t val = g_sort_mode == SORT_MTIME ? dl->mtime[i] : dl->size[i];
+        uint64_t payload = g_sort_reverse ? val : ~val;
+        return dirbit | (payload & ~((uint64_t)1 << 63));
+    }
+
+    unsigned char buf[7] = {0};
+
+    if (!g_natural_sort) {
+        for (size_t k = 0; k < sizeof(buf) && name[k]; ++k) {
+            buf[k] = name[k];
+        }
+    } else {
+        size_t k = 0;
+        size_t p = 0;
+        while (k < sizeof(buf) && name[p]) {
+            if (isdigit(name[p])) {
+                while (name[p] == '0' && isdigit(name[p + 1])) {
+                    ++p;
+                }
+
+                size_t rs = p;
+                while (isdigit(name[p])) {
+                    ++p;
+                }
+
+                size_t runlen = p - rs;
+                buf[k++] = (unsigned char)(1 + (runlen > 30 ? 30 : runlen));
+                for (size_t q = rs; q < p && k < sizeof(buf); ++q) {
+                    buf[k++] = name[q];
+                }
+            } else {
+                buf[k++] = name[p++];
+            }
+        }
+    }
+
+    uint64_t payload = 0;
+    for (size_t k = 0; k < sizeof(buf); ++k) {
+        payload |= (uint64_t)buf[k] << (8 * (6 - k));
+    }
+    if (g_sort_reverse) {
+        payload = ~payload & ~((uint64_t)1 << 63);
+    }
+
+    return dirbit | payload;
+}
+
+/**
+ * Full comparison for entries whose keys tie (names agreeing in the first
+ * seven bytes, or equal mtime/size). Ties under mtime and size order break
+ * on the name, ascending either way
+ */
+static int
+sortkeycmp(const void *va, const void *vb)
+{
+    const struct sortkey *a = va;
+    const struct sortkey *b = vb;
+
+    if (a->key != b->key) {
+        return a->key < b->key ? -1 : 1;
+    }
+
+    const char *na = ent_name(g_sort_dl, a->idx);
+    const char *nb = ent_name(g_sort_dl, b->idx);
+    int cmp        = g_natural_sort ? natcmp(na, nb) : strcmp(na, nb);
+    return g_sort_mode == SORT_NAME && g_sort_reverse ? -cmp : cmp;
+}
+
+/**
+ * Insertion sort for small buckets
+ */
+static void
+sortkey_insertion(struct sortkey *a, size_t n)
+{
+    for (size_t i = 1; i < n; ++i) {
+        struct sortkey tmp = a[i];
+        size_t j           = i;
+        while (j > 0 && sortkeycmp(&tmp, &a[j - 1]) < 0) {
+            a[j] = a[j - 1];
+            --j;
+        }
+        a[j] = tmp;
+    }
+}
+
+#define RADIX_CUTOFF 32
+
+/**
+ * MSD radix sort over the packed keys, one byte per level. Small buckets
+ * drop to insertion sort; buckets whose full keys are exhausted (long
+ * common prefixes) fall back to a comparator sort on the names
+ */
+static void
+radix_sort_msd(
+    struct sortkey *a,
+    struct sortkey *scratch,
+    size_t n,
+    int shift)
+{
+    if (n <= RADIX_CUTOFF) {
+        sortkey_insertion(a, n);
+        return;
+    }
+
+    if (shift < 0) {
+        qsort(a, n, sizeof(*a), sortkeycmp);
+        return;
+    }
+
+    size_t count[256] = {0};
+    for (size_t i = 0; i < n; ++i) {
+        ++count[(a[i].key >> shift) & 0xff];
+    }
+
+    size_t start[256];
+    size_t pos = 0;
+    for (size_t b = 0; b < 256; ++b) {
+        start[b] = pos;
+        pos += count[b];
+    }
+
+    size_t fill[256];
+    memcpy(fill, start, sizeof(fill));
+    for (size_t i = 0; i < n; ++i) {
+        scratch[fill[(a[i].key >> shift) & 0xff]++] = a[i];
+    }
+    memcpy(a, scratch, n * sizeof(*a));
+
+    for (size_t b = 0; b < 256; ++b) {
+        if (count[b] > 1) {
+            radix_sort_msd(a + start[b], scratch + start[b], count[b],
+                           shift - 8);
+        }
+    }
+}
+
+/**
+ * Sorts a listing by sorting precomputed (key, index) pairs and applying
+ * the permutation to the parallel arrays. The arena itself stays put
+ */
+static void
+dirlist_sort(struct dirlist *dl)
+{
+    if (dl->n < 2) {
+        return;
+    }
+
+    struct sortkey *keys    = malloc(dl->n * sizeof(*keys));
+    struct sortkey *scratch = malloc(dl->n * sizeof(*scratch));
+    uint32_t *off           = malloc(dl->n * sizeof(*off));
+    uint8_t *bytes          = malloc(dl->n * 2 * sizeof(*bytes));
+    uint64_t *sizes         = malloc(dl->n * 3 * sizeof(*sizes));
+    uint16_t *shorts        = malloc(dl->n * 3 * sizeof(*shorts));
+    if (!keys || !scratch || !off || !bytes || !sizes || !shorts) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < dl->n; ++i) {
+        keys[i].key = sort_key(dl, (uint32_t)i);
+        keys[i].idx = (uint32_t)i;
+    }
+
+    g_sort_dl = dl;
+    radix_sort_msd(keys, scratch, dl->n, 56);
+    g_sort_dl = NULL;
+
+    for (size_t i = 0; i < dl->n; ++i) {
+        off[i]           = dl->name_off[keys[i].idx];
+        bytes[i]         = dl->type[keys[i].idx];
+        bytes[dl->n + i] = dl->flags[keys[i].idx];
+        sizes[i]             = dl->size[keys[i].idx];
+        sizes[dl->n + i]     = dl->mtime[keys[i].idx];
+        sizes[dl->n * 2 + i] = dl->ino[keys[i].idx];
+        shorts[i]            = dl->color[keys[i].idx];
+        shorts[dl->n + i]    = dl->dwidth[keys[i].idx];
+        shorts[dl->n * 2 + i] = dl->dtrunc[keys[i].idx];
+    }
+    memcpy(dl->name_off, off, dl->n * sizeof(*off));
+    memcpy(dl->type, bytes, dl->n);
+    memcpy(dl->flags, bytes + dl->n, dl->n);
+    memcpy(dl->size, sizes, dl->n * sizeof(*sizes));
+    memcpy(dl->mtime, sizes + dl->n, dl->n * sizeof(*sizes));
+    memcpy(dl->ino, sizes + dl->n * 2, dl->n * sizeof(*sizes));
+    memcpy(dl->color, shorts, dl->n * sizeof(*shorts));
+    memcpy(dl->dwidth, shorts + dl->n, dl->n * sizeof(*shorts));
+    memcpy(dl->dtrunc, shorts + dl->n * 2, dl->n * sizeof(*shorts));
+    dl->by_off_dirty = true;
+
+    free(keys);
+    free(scratch);
+    free(off);
+    free(bytes);
+    free(sizes);
+    free(shorts);
+}
+
+/**
+ * Where an entry with the given dir-ness and cached metadata sorts
+ * relative to entry i, under the active sort order
+ */
+static int
+dirlist_order_cmp(
+    const struct dirlist *dl,
+    size_t i,
+    const char *name,
+    bool is_dir,
+    uint64_t mtime,
+    uint64_t size)
+{
+    bool i_dir = dl->type[i] == TYPE_DIR || dl->type[i] == TYPE_SYML_TO_DIR;
+
+    if (i_dir != is_dir) {
+        return i_dir ? -1 : 1;
+    }
+
+    if (g_sort_mode != SORT_NAME) {
+        uint64_t vi = g_sort_mode == SORT_MTIME ? dl->mtime[i] : dl->size[i];
+        uint64_t vn = g_sort_mode == SORT_MTIME ? mtime : size;
+        if (vi != vn) {
+            int cmp = vi > vn ? -1 : 1; // larger first
+            return g_sort_reverse ? -cmp : cmp;
+        }
+    }
+
+    int cmp = g_natural_sort ? natcmp(ent_name(dl, i), name)
+                             : strcmp(ent_name(dl, i), name);
+    return g_sort_mode == SORT_NAME && g_sort_reverse ? -cmp : cmp;
+}
+
+/**
+ * Inserts one entry at its sorted position (binary search + memmove).
+ * The name lands at the end of the arena; only the index arrays shift
+ */
+static void
+dirlist_insert_sorted(
+    struct dirlist *dl,
+    const char *name,
+    uint8_t type,
+    uint8_t flags,
+    uint64_t mtime,
+    uint64_t fsize)
+{
+    bool is_dir = type == TYPE_DIR || type == TYPE_SYML_TO_DIR;
+
+    size_t lo = 0;
+    size_t hi = dl->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (dirlist_order_cmp(dl, mid, name, is_dir, mtime, fsize) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    dirlist_push(dl, name, type, flags);
+    dl->mtime[dl->n - 1] = mtime;
+    dl->size[dl->n - 1]  = fsize;
+
+    size_t pos = lo;
+    if (pos < dl->n - 1) {
+        uint32_t off  = dl->name_off[dl->n - 1];
+        uint8_t typ   = dl->type[dl->n - 1];
+        uint8_t flag_ = dl->flags[dl->n - 1];
+        uint64_t size  = dl->size[dl->n - 1];
+        uint64_t mtime_ = dl->mtime[dl->n - 1];
+        uint64_t ino   = dl->ino[dl->n - 1];
+        uint16_t color = dl->color[dl->n - 1];
+        uint16_t dwidth = dl->dwidth[dl->n - 1];
+        uint16_t dtrunc = dl->dtrunc[dl->n - 1];
+
+        memmove(
+            dl->name_off + pos + 1,
+            dl->name_off + pos,
+            (dl->n - 1 - pos) * sizeof(*dl->name_off));
+        memmove(dl->type + pos + 1, dl->type + pos, dl->n - 1 - pos);
+        memmove(dl->flags + pos + 1, dl->flags + pos, dl->n - 1 - pos);
+        memmove(
+            dl->size + pos + 1,
+            dl->size + pos,
+            (dl->n - 1 - pos) * sizeof(*dl->size));
+        memmove(
+            dl->mtime + pos + 1,
+            dl->mtime + pos,
+            (dl->n - 1 - pos) * sizeof(*dl->mtime));
+        memmove(
+            dl->ino + pos + 1,
+            dl->ino + pos,
+            (dl->n - 1 - pos) * sizeof(*dl->ino));
+        memmove(
+            dl->color + pos + 1,
+            dl->color + pos,
+            (dl->n - 1 - pos) * sizeof(*dl->color));
+        memmove(
+            dl->dwidth + pos + 1,
+            dl->dwidth + pos,
+            (dl->n - 1 - pos) * sizeof(*dl->dwidth));
+        memmove(
+            dl->dtrunc + pos + 1,
+            dl->dtrunc + pos,
+            (dl->n - 1 - pos) * sizeof(*dl->dtrunc));
+
+        dl->name_off[pos] = off;
+        dl->type[pos]     = typ;
+        dl->flags[pos]    = flag_;
+        dl->size[pos]     = size;
+        dl->mtime[pos]    = mtime_;
+        dl->ino[pos]      = ino;
+        dl->color[pos]    = color;
+        dl->dwidth[pos]   = dwidth;
+        dl->dtrunc[pos]   = dtrunc;
+    }
+}
+
+/**
+ * Finds an entry by name. Binary search first; entries whose type got
+ * upgraded after sorting (symlinks to dirs) may sit off their comparator
+ * position, and the probe's metadata is unknown under mtime/size order,
+ * so a miss falls back to a linear scan
+ */
+static ssize_t
+dirlist_find(const struct dirlist *dl, const char *name, bool is_dir)
+{
+    size_t lo = 0;
+    size_t hi = dl->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp    = dirlist_order_cmp(dl, mid, name, is_dir, 0, 0);
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else if (cmp > 0) {
+            hi = mid;
+        } else {
+            return (ssize_t)mid;
+        }
+    }
+
+    for (size_t i = 0; i < dl->n; ++i) {
+        if (strcmp(ent_name(dl, i), name) == 0) {
+            return (ssize_t)i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Removes entry pos from the index arrays. Its name stays as dead bytes
+ * in the arena until the next full rescan repacks it
+ */
+static void
+dirlist_remove(struct dirlist *dl, size_t pos)
+{
+    memmove(
+        dl->name_off + pos,
+        dl->name_off + pos + 1,
+        (dl->n - 1 - pos) * sizeof(*dl->name_off));
+    memmove(dl->type + pos, dl->type + pos + 1, dl->n - 1 - pos);
+    memmove(dl->flags + pos, dl->flags + pos + 1, dl->n - 1 - pos);
+    memmove(
+        dl->color + pos,
+        dl->color + pos + 1,
+        (dl->n - 1 - pos) * sizeof(*dl->color));
+    memmove(
+        dl->dwidth + pos,
+        dl->dwidth + pos + 1,
+        (dl->n - 1 - pos) * sizeof(*dl->dwidth));
+    memmove(
+        dl->dtrunc + pos,
+        dl->dtrunc + pos + 1,
+        (dl->n - 1 - pos) * sizeof(*dl->dtrunc));
+    memmove(
+        dl->size + pos,
+        dl->size + pos + 1,
+        (dl->n - 1 - pos) * sizeof(*dl->size));
+    memmove(
+        dl->mtime + pos,
+        dl->mtime + pos + 1,
+        (dl->n - 1 - pos) * sizeof(*dl->mtime));
+    memmove(
+        dl->ino + pos,
+        dl->ino + pos + 1,
+        (dl->n - 1 - pos) * sizeof(*dl->ino));
+    --dl->n;
+    dl->by_off_dirty = true;
+}
+
+// the view range the stat pool was last asked to cover. Reposts happen
+// only when it changes, so the repaint a finished stat triggers doesn't
+// cancel the rest of its own batch
+static struct {
+    const struct dirlist *dl;
+    size_t first;
+    size_t lim;
+} g_stat_want;
+
+/**
+ * Rebuilds the view index from the visibility mask. Toggling hidden
+ * entries is just this plus a repaint - no I/O, no resort
+ */
+static void
+dirlist_rebuild_view(struct dirlist *dl, bool show_hidden)
+{
+    g_stat_want.dl = NULL; // view positions are about to change
+
+    if (dl->view_cap < dl->cap) {
+        uint32_t *view = realloc(dl->view, dl->cap * sizeof(*view));
+        if (!view) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        dl->view     = view;
+        dl->view_cap = dl->cap;
+    }
+
+    dl->nview = 0;
+    for (size_t i = 0; i < dl->n; ++i) {
+        if (show_hidden || !(dl->flags[i] & ENT_HIDDEN)) {
+            dl->view[dl->nview++] = (uint32_t)i;
+        }
+    }
+}
+
+/**
+ * View position of the entry called name, or 0 if it isn't visible
+ */
+static size_t
+view_find(const struct dirlist *dl, const char *name)
+{
+    for (size_t v = 0; v < dl->nview; ++v) {
+        if (strcmp(ent_name(dl, dl->view[v]), name) == 0) {
+            return v;
+        }
+    }
+
+    return 0;
+}
+
+// the type-ahead search: query typed so far, and whether '/' is active
+static char g_search[NAME_MAX + 1];
+static bool g_search_mode;
+
+/**
+ * Orders entry positions by where their name sits in the arena
+ */
+static int
+byoffcmp(const void *va, const void *vb)
+{
+    uint32_t a = g_sort_dl->name_off[*(const uint32_t *)va];
+    uint32_t b = g_sort_dl->name_off[*(const uint32_t *)vb];
+
+    return a < b ? -1 : a > b;
+}
+
+/**
+ * The entry whose name contains arena offset off, or -1 if off points
+ * into dead bytes left behind by a removed entry
+ */
+static ssize_t
+dirlist_entry_at(const struct dirlist *dl, uint32_t off)
+{
+    size_t lo = 0;
+    size_t hi = dl->n;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (dl->name_off[dl->by_off[mid]] <= off) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    uint32_t e = dl->by_off[lo];
+    if (off < dl->name_off[e] ||
+        off > dl->name_off[e] + strlen(ent_name(dl, e))) {
+        return -1;
+    }
+
+    return (ssize_t)e;
+}
+
+/**
+ * Rebuilds the view down to the entries whose name contains the query.
+ *
+ * Instead of a strstr per entry this scans the packed name arena once:
+ * memchr for the query's first byte, then one memcmp per candidate. The
+ * query can't straddle two names - it contains no NUL and the names are
+ * NUL-separated - so any full match maps to exactly one entry
+ */
+static void
+dirlist_search_view(struct dirlist *dl, bool show_hidden, const char *query)
+{
+    size_t qlen = strlen(query);
+
+    if (qlen == 0) {
+        dirlist_rebuild_view(dl, show_hidden);
+        return;
+    }
+
+    if (dl->by_off_dirty) {
+        uint32_t *by_off = realloc(dl->by_off, dl->cap * sizeof(*by_off));
+        if (!by_off) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < dl->n; ++i) {
+            by_off[i] = (uint32_t)i;
+        }
+        g_sort_dl = dl;
+        qsort(by_off, dl->n, sizeof(*by_off), byoffcmp);
+        g_sort_dl        = NULL;
+        dl->by_off       = by_off;
+        dl->by_off_dirty = false;
+    }
+
+    uint8_t *match = calloc(dl->n ? dl->n : 1, 1);
+    if (!match) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    const char *end = dl->arena + dl->arena_len;
+    const char *p   = dl->arena;
+    while (p + qlen <= end &&
+           (p = memchr(p, query[0], (size_t)(end - p) - qlen + 1))) {
+        if (memcmp(p, query, qlen) != 0) {
+            ++p;
+            continue;
+        }
+
+        ssize_t e = dirlist_entry_at(dl, (uint32_t)(p - dl->arena));
+        if (e < 0) {
+            ++p; // a match inside dead bytes
+            continue;
+        }
+
+        match[e] = 1;
+        // one hit per name is enough; jump past it
+        p = dl->arena + dl->name_off[e] + strlen(ent_name(dl, e));
+    }
+
+    dirlist_rebuild_view(dl, show_hidden);
+    size_t nview = 0;
+    for (size_t v = 0; v < dl->nview; ++v) {
+        if (match[dl->view[v]]) {
+            dl->view[nview++] = dl->view[v];
+        }
+    }
+    dl->nview = nview;
+
+    free(match);
+}
+
+/**
+ * Rebuilds the view, keeping an accepted search narrowing in force
+ */
+static void
+view_refresh(struct dirlist *dl, bool show_hidden)
+{
+    if (g_search[0] != '\0') {
+        dirlist_search_view(dl, show_hidden, g_search);
+    } else {
+        dirlist_rebuild_view(dl, show_hidden);
+    }
+}
+
+#define MARK_EMPTY 0
+#define MARK_USED 1
+#define MARK_DEAD 2 // tombstone: keeps probe chains intact
+
+/**
+ * One slot of the selection set. Marks are keyed by identity, not by
+ * listing position, so they survive rescans, hidden toggles and leaving
+ * the directory entirely
+ */
+struct mark {
+    uint64_t dev;
+    uint64_t ino;
+    uint8_t state;
+};
+
+static struct mark *g_marks;
+static size_t g_marks_cap;  // a power of two
+static size_t g_marks_n;    // live marks
+static size_t g_marks_fill; // live marks + tombstones
+
+static size_t
+mark_hash(uint64_t dev, uint64_t ino)
+{
+    uint64_t h = (ino ^ dev) * UINT64_C(0x9e3779b97f4a7c15);
+    return (size_t)(h ^ (h >> 32));
+}
+
+/**
+ * O(1) membership check; this is what draw_line calls per row
+ */
+static bool
+mark_has(uint64_t dev, uint64_t ino)
+{
+    if (g_marks_n == 0 || ino == 0) {
+        return false;
+    }
+
+    for (size_t i = mark_hash(dev, ino);; ++i) {
+        struct mark *m = &g_marks[i & (g_marks_cap - 1)];
+        if (m->state == MARK_EMPTY) {
+            return false;
+        }
+        if (m->state == MARK_USED && m->dev == dev && m->ino == ino) {
+            return true;
+        }
+    }
+}
+
+/**
+ * Rehashes into a table of the given capacity, shedding tombstones
+ */
+static void
+mark_rehash(size_t cap)
+{
+    struct mark *old = g_marks;
+    size_t old_cap   = g_marks_cap;
+
+    g_marks = calloc(cap, sizeof(*g_marks));
+    if (!g_marks) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    g_marks_cap  = cap;
+    g_marks_fill = g_marks_n;
+
+    for (size_t i = 0; i < old_cap; ++i) {
+        if (old[i].state != MARK_USED) {
+            continue;
+        }
+        for (size_t j = mark_hash(old[i].dev, old[i].ino);; ++j) {
+            struct mark *m = &g_marks[j & (cap - 1)];
+            if (m->state == MARK_EMPTY) {
+                *m = old[i];
+                break;
+            }
+        }
+    }
+
+    free(old);
+}
+
+/**
+ * Adds or removes one mark
+ */
+static void
+mark_toggle(uint64_t dev, uint64_t ino)
+{
+    if (ino == 0) {
+        return; // identity unknown (freshly created, stat failed)
+    }
+
+    if (g_marks_cap == 0) {
+        mark_rehash(64);
+    }
+
+    struct mark *dead = NULL;
+    for (size_t i = mark_hash(dev, ino);; ++i) {
+        struct mark *m = &g_marks[i & (g_marks_cap - 1)];
+        if (m->state == MARK_USED && m->dev == dev && m->ino == ino) {
+            m->state = MARK_DEAD;
+            --g_marks_n;
+            return;
+        }
+        if (m->state == MARK_DEAD && !dead) {
+            dead = m;
+        }
+        if (m->state == MARK_EMPTY) {
+            struct mark *slot = dead ? dead : m;
+            if (slot == m) {
+                ++g_marks_fill;
+            }
+            *slot = (struct mark){.dev = dev, .ino = ino,
+                                  .state = MARK_USED};
+            ++g_marks_n;
+            if (g_marks_fill * 4 >= g_marks_cap * 3) {
+                mark_rehash(g_marks_cap * 2);
+            }
+            return;
+        }
+    }
+}
+
+/**
+ * Drops one mark if present (x and y clear what they consumed)
+ */
+static void
+mark_remove(uint64_t dev, uint64_t ino)
+{
+    if (mark_has(dev, ino)) {
+        mark_toggle(dev, ino);
+    }
+}
+
+/**
+ * One deferred fstatat, handed to the stat pool
+ */
+struct stat_job {
+    uint32_t idx;
+    int type; // provisional type derived from d_type
+    char name[NAME_MAX + 1];
+};
+
+/**
+ * A finished classification, flowing back through the result ring
+ */
+struct stat_result {
+    uint32_t idx;
+    unsigned gen;
+    int type;
+    uint64_t size;  // st_size seen by the classifying stat
+    uint64_t mtime; // st_mtim, nanoseconds since the epoch
+    bool has_meta;  // whether a stat actually succeeded
+};
+
+static pthread_mutex_t g_stat_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_stat_cond = PTHREAD_COND_INITIALIZER;
+static struct stat_job *g_stat_jobs;
+static size_t g_stat_njobs;
+static atomic_size_t g_stat_cursor;
+static atomic_uint g_stat_gen;
+static int g_stat_fd = -1;
+static int g_stat_busy;
+static bool g_stat_started;
+
+static int g_wake_pipe[2]; // defined with the winch plumbing below
+
+// a sort-mode switch waiting for the pool to backfill metadata; the
+// resort runs once the batch drains, keeping the interim order intact
+static struct {
+    const struct dirlist *dl;
+    unsigned gen;
+} g_meta_wait;
+
+static struct {
+    atomic_uint seq;
+    struct stat_result res;
+} g_stat_ring[STAT_RING_SIZE];
+static atomic_uint g_stat_ring_head;
+static unsigned g_stat_ring_tail;
+
+/**
+ * Nanoseconds since the epoch, the form the mtime sort key wants
+ */
+static uint64_t
+mtime_ns(const struct stat *sb)
+{
+    return (uint64_t)sb->st_mtim.tv_sec * UINT64_C(1000000000) +
+        (uint64_t)sb->st_mtim.tv_nsec;
+}
+
+/**
+ * Runs the stat(s) needed to turn a provisional type into a final one.
+ * The entry's own (symlink-aware) stat lands in *meta as a side effect;
+ * meta->st_mode stays 0 if no stat succeeded
+ */
+static int
+stat_classify(int fd, const char *name, int provisional, struct stat *meta)
+{
+    struct stat sb;
+
+    if (provisional == TYPE_SYML) {
+        // the entry's own metadata is the link's, not the target's
+        if (meta->st_mode == 0) {
+            INSTR_COUNT(n_stat);
+            fstatat(fd, name, meta, AT_SYMLINK_NOFOLLOW);
+        }
+        INSTR_COUNT(n_stat);
+        if (!(fstatat(fd, name, &sb, 0) < 0 || !S_ISDIR(sb.st_mode))) {
+            return TYPE_SYML_TO_DIR;
+        }
+        return TYPE_SYML;
+    }
+
+    INSTR_COUNT(n_stat);
+    if (fstatat(fd, name, &sb, AT_SYMLINK_NOFOLLOW) < 0) {
+        return provisional;
+    }
+    *meta = sb;
+
+    if (S_ISDIR(sb.st_mode)) {
+        return TYPE_DIR;
+    }
+    if (S_ISLNK(sb.st_mode)) {
+        // an entry we didn't know was a symlink: resolve its target too
+        return stat_classify(fd, name, TYPE_SYML, meta);
+    }
+
+    if (sb.st_mode & S_IXUSR) {
+        return TYPE_EXEC;
+    }
+    return TYPE_NORM;
+}
+
+/**
+ * Publishes a result into the lock-free ring (Vyukov-style bounded queue).
+ * A full ring simply drops the result; the on-display fallback stat in
+ * resolve_entry still catches those entries
+ */
+static void
+stat_ring_push(struct stat_result res)
+{
+    unsigned pos =
+        atomic_load_explicit(&g_stat_ring_head, memory_order_relaxed);
+    for (;;) {
+        unsigned seq = atomic_load_explicit(
+            &g_stat_ring[pos % STAT_RING_SIZE].seq, memory_order_acquire);
+        int diff = (int)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak(&g_stat_ring_head, &pos,
+                                             pos + 1)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return; // full
+        } else {
+            pos =
+                atomic_load_explicit(&g_stat_ring_head, memory_order_relaxed);
+        }
+    }
+
+    g_stat_ring[pos % STAT_RING_SIZE].res = res;
+    atomic_store_explicit(
+        &g_stat_ring[pos % STAT_RING_SIZE].seq,
+        pos + 1,
+        memory_order_release);
+}
+
+/**
+ * Takes one result out of the ring. Only the main thread consumes
+ */
+static bool
+stat_ring_pop(struct stat_result *out)
+{
+    unsigned pos = g_stat_ring_tail;
+    unsigned seq = atomic_load_explicit(
+        &g_stat_ring[pos % STAT_RING_SIZE].seq, memory_order_acquire);
+    if ((int)(seq - (pos + 1)) < 0) {
+        return false;
+    }
+
+    *out = g_stat_ring[pos % STAT_RING_SIZE].res;
+    atomic_store_explicit(
+        &g_stat_ring[pos % STAT_RING_SIZE].seq,
+        pos + STAT_RING_SIZE,
+        memory_order_release);
+    g_stat_ring_tail = pos + 1;
+
+    return true;
+}
+
+/**
+ * Stat pool worker. Grabs job indices with a single fetch_add, bails out
+ * as soon as the generation moves on
+ */
+static void *
+stat_worker(void *arg)
+{
+    (void)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&g_stat_mtx);
+        while (atomic_load(&g_stat_cursor) >= g_stat_njobs) {
+            pthread_cond_wait(&g_stat_cond, &g_stat_mtx);
+        }
+        unsigned gen          = atomic_load(&g_stat_gen);
+        int fd                = g_stat_fd;
+        struct stat_job *jobs = g_stat_jobs;
+        size_t njobs          = g_stat_njobs;
+        ++g_stat_busy;
+        pthread_mutex_unlock(&g_stat_mtx);
+
+        for (;;) {
+            if (atomic_load(&g_stat_gen) != gen) {
+                break;
+            }
+
+            size_t i = atomic_fetch_add(&g_stat_cursor, 1);
+            if (i >= njobs) {
+                break;
+            }
+
+            struct stat_result res = {
+                .idx = jobs[i].idx,
+                .gen = gen,
+            };
+            struct stat meta = {0};
+            res.type = stat_classify(fd, jobs[i].name, jobs[i].type, &meta);
+            if (meta.st_mode != 0) {
+                res.size     = (uint64_t)meta.st_size;
+                res.mtime    = mtime_ns(&meta);
+                res.has_meta = true;
+            }
+            stat_ring_push(res);
+        }
+
+        pthread_mutex_lock(&g_stat_mtx);
+        --g_stat_busy;
+        pthread_cond_broadcast(&g_stat_cond);
+        bool last = g_stat_busy == 0;
+        pthread_mutex_unlock(&g_stat_mtx);
+
+        if (last) {
+            // poke the event loop so the batch's results get merged
+            ssize_t ignored = write(g_wake_pipe[1], "", 1);
+            (void)ignored;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Hands a range of entries to the worker pool, cancelling whatever batch
+ * was in flight first. Viewport batches take [first, lim) as view
+ * positions and skip entries already classified; a meta batch takes raw
+ * entry indices and skips entries whose metadata is already cached
+ */
+static void
+stat_pool_submit(const struct dirlist *dl, size_t first, size_t lim, bool meta)
+{
+    if (!g_stat_started) {
+        for (unsigned i = 0; i < STAT_RING_SIZE; ++i) {
+            atomic_init(&g_stat_ring[i].seq, i);
+        }
+
+        for (int i = 0; i < STAT_POOL_NTHREADS; ++i) {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, stat_worker, NULL) != 0) {
+                return; // resolve_entry still works without the pool
+            }
+            pthread_detach(thread);
+        }
+
+        g_stat_started = true;
+    }
+
+    pthread_mutex_lock(&g_stat_mtx);
+
+    atomic_fetch_add(&g_stat_gen, 1);
+    atomic_store(&g_stat_cursor, g_stat_njobs); // stop pickup of old jobs
+    while (g_stat_busy > 0) {
+        pthread_cond_wait(&g_stat_cond, &g_stat_mtx);
+    }
+
+    free(g_stat_jobs);
+    g_stat_jobs  = NULL;
+    g_stat_njobs = 0;
+    if (g_stat_fd >= 0) {
+        close(g_stat_fd);
+        g_stat_fd = -1;
+    }
+
+    uint32_t done = meta ? ENT_META_DONE : ENT_STAT_DONE;
+    if (lim > (meta ? dl->n : dl->nview)) {
+        lim = meta ? dl->n : dl->nview;
+    }
+
+    size_t npending = 0;
+    for (size_t v = first; v < lim; ++v) {
+        if (!(dl->flags[meta ? v : dl->view[v]] & done)) {
+            ++npending;
+        }
+    }
+
+    if (npending == 0 || g_dirfd < 0) {
+        pthread_mutex_unlock(&g_stat_mtx);
+        return;
+    }
+
+    g_stat_jobs = malloc(npending * sizeof(*g_stat_jobs));
+    if (!g_stat_jobs) {
+        pthread_mutex_unlock(&g_stat_mtx);
+        return;
+    }
+
+    size_t j = 0;
+    for (size_t v = first; v < lim; ++v) {
+        uint32_t i = meta ? (uint32_t)v : dl->view[v];
+        if (dl->flags[i] & done) {
+            continue;
+        }
+        g_stat_jobs[j].idx  = i;
+        g_stat_jobs[j].type = dl->type[i];
+        strcpy(g_stat_jobs[j].name, ent_name(dl, i));
+        ++j;
+    }
+
+    g_stat_fd = dup(g_dirfd);
+    if (g_stat_fd < 0) {
+        free(g_stat_jobs);
+        g_stat_jobs = NULL;
+        pthread_mutex_unlock(&g_stat_mtx);
+        return;
+    }
+
+    g_stat_njobs = npending;
+    atomic_store(&g_stat_cursor, 0);
+    pthread_cond_broadcast(&g_stat_cond);
+    pthread_mutex_unlock(&g_stat_mtx);
+}
+
+/**
+ * Hands the view range [first, lim) to the worker pool, skipping entries
+ * already classified. Keeping the batch at viewport size means scan cost
+ * no longer scales with the symlink count - offscreen links into slow
+ * storage are never touched
+ */
+static void
+stat_pool_post(const struct dirlist *dl, size_t first, size_t lim)
+{
+    stat_pool_submit(dl, first, lim, false);
+}
+
+/**
+ * Queues every entry whose metadata is still missing, so a sort by mtime
+ * or size can backfill the stragglers off the UI thread. The listing
+ * keeps its current order until the whole batch has landed; run_session
+ * then runs the deferred resort
+ */
+static void
+stat_pool_post_meta(const struct dirlist *dl)
+{
+    stat_pool_submit(dl, 0, dl->n, true);
+    g_meta_wait.dl  = dl;
+    g_meta_wait.gen = atomic_load(&g_stat_gen);
+    g_stat_want.dl  = NULL; // the viewport batch was cancelled with the rest
+}
+
+/**
+ * Drops the in-flight batch and whatever deferred resort rode on it.
+ * Jobs and results are keyed by entry index, so anything that inserts,
+ * removes or permutes entries must cancel here before stale results
+ * land on the wrong ones; the next repaint reposts the viewport
+ */
+static void
+stat_pool_invalidate(void)
+{
+    g_meta_wait.dl = NULL;
+    g_stat_want.dl = NULL;
+
+    pthread_mutex_lock(&g_stat_mtx);
+    atomic_fetch_add(&g_stat_gen, 1);
+    atomic_store(&g_stat_cursor, g_stat_njobs); // stop pickup of old jobs
+    pthread_mutex_unlock(&g_stat_mtx);
+}
+
+/**
+ * True once no worker holds a job from the current batch - with the ring
+ * drained afterwards, every result of that batch has been merged
+ */
+static bool
+stat_pool_idle(void)
+{
+    pthread_mutex_lock(&g_stat_mtx);
+    bool idle =
+        atomic_load(&g_stat_cursor) >= g_stat_njobs && g_stat_busy == 0;
+    pthread_mutex_unlock(&g_stat_mtx);
+
+    return idle;
+}
+
+/**
+ * Asks the pool to cover the viewport. Called from the draw path, so a
+ * range is posted exactly once per time it becomes visible and the
+ * repaints its results trigger don't repost it
+ */
+static void
+stat_pool_want(const struct dirlist *dl, size_t first, size_t lim)
+{
+    if (g_meta_wait.dl) {
+        return; // the pending meta batch is statting everything anyway
+    }
+
+    if (g_stat_want.dl == dl && g_stat_want.first == first &&
+        g_stat_want.lim == lim) {
+        return;
+    }
+
+    g_stat_want.dl    = dl;
+    g_stat_want.first = first;
+    g_stat_want.lim   = lim;
+    stat_pool_post(dl, first, lim);
+}
+
+/**
+ * Merges finished classifications back into ents, reporting whether
+ * anything on display may have changed. Results from an older directory
+ * generation are dropped
+ */
+static bool
+stat_pool_drain(struct dirlist *dl)
+{
+    unsigned gen = atomic_load(&g_stat_gen);
+    struct stat_result res;
+    bool changed = false;
+
+    while (stat_ring_pop(&res)) {
+        if (res.gen != gen || res.idx >= dl->n) {
+            continue;
+        }
+        if (!(dl->flags[res.idx] & ENT_STAT_DONE)) {
+            changed           = true;
+            dl->type[res.idx] = (uint8_t)res.type;
+            dl->flags[res.idx] |= ENT_STAT_DONE;
+        }
+        // a meta batch revisits classified entries just for this part
+        if (res.has_meta && !(dl->flags[res.idx] & ENT_META_DONE)) {
+            changed            = true;
+            dl->mtime[res.idx] = res.mtime;
+            dl->flags[res.idx] |= ENT_META_DONE;
+            if (res.type != TYPE_DIR) {
+                // directories wait for the walker's recursive total
+                dl->size[res.idx] = res.size;
+                dl->flags[res.idx] |= ENT_SIZE_DONE;
+            }
+        }
+    }
+
+    return changed;
+}
+
+/**
+ * One directory whose recursive total the size worker still owes us
+ */
+struct size_job {
+    uint64_t ino;
+    char name[NAME_MAX + 1];
+};
+
+/**
+ * A finished total, flowing back to the main thread. It names its entry
+ * by inode, not index: totals can take minutes, and inotify inserts or
+ * a resort may have moved every index by the time one lands
+ */
+struct size_result {
+    uint64_t ino;
+    unsigned gen;
+    uint64_t total;
+};
+
+/**
+ * Totals already computed, keyed by identity and validated by mtime.
+ * Only the size worker touches this, so no locking. The top-level mtime
+ * misses changes deeper in the tree until something renames or rewrites
+ * through the directory itself - the price of free re-entry
+ */
+struct size_cache_ent {
+    bool used;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtim;
+    uint64_t total;
+};
+
+static bool g_show_sizes; // the size column is toggled on
+static bool g_quit_armed; // q pressed once while a worker was mid-job
+static bool g_grid;       // ls -C style multi-column layout is toggled on
+static bool g_preview;    // the preview pane is toggled on
+
+static pthread_mutex_t g_size_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_size_cond = PTHREAD_COND_INITIALIZER;
+static struct size_job *g_size_jobs;
+static size_t g_size_njobs;
+static atomic_uint g_size_gen;
+static int g_size_fd = -1;
+static int g_size_busy;
+static bool g_size_started;
+
+static struct size_cache_ent g_size_cache[SIZE_CACHE_SIZE];
+
+// single producer (the size worker), single consumer (the main thread)
+static struct size_result g_size_ring[SIZE_RING_SIZE];
+static atomic_uint g_size_ring_head;
+static atomic_uint g_size_ring_tail;
+
+/**
+ * Accumulates file sizes across walker threads
+ */
+struct size_walk {
+    atomic_uint_fast64_t total;
+};
+
+static void
+size_walk_file(int dirfd, const char *name, void *tag, void *ud)
+{
+    (void)tag;
+    struct size_walk *sw = ud;
+    struct stat sb;
+
+    if (fstatat(dirfd, name, &sb, AT_SYMLINK_NOFOLLOW) == 0) {
+        atomic_fetch_add(&sw->total, (uint64_t)sb.st_size);
+    }
+}
+
+static void
+size_walk_dir_done(int parent_fd, const char *name, int fd, void *tag, void *ud)
+{
+    (void)parent_fd;
+    (void)name;
+    (void)fd;
+    (void)tag;
+    (void)ud;
+}
+
+static const struct walker_ops g_size_walker_ops = {
+    .file     = size_walk_file,
+    .dir_done = size_walk_dir_done,
+};
+
+/**
+ * Publishes one total. Unlike the stat ring, dropping here would lose the
+ * entry for good, so a full ring waits for the consumer - unless the
+ * batch got cancelled in the meantime
+ */
+static void
+size_ring_push(struct size_result res, unsigned gen)
+{
+    unsigned head = atomic_load_explicit(&g_size_ring_head,
+                                         memory_order_relaxed);
+
+    while (head - atomic_load_explicit(&g_size_ring_tail,
+                                       memory_order_acquire) >=
+           SIZE_RING_SIZE) {
+        if (atomic_load(&g_size_gen) != gen) {
+            return;
+        }
+        struct timespec ts = {0, 1000000}; // 1ms
+        nanosleep(&ts, NULL);
+    }
+
+    g_size_ring[head % SIZE_RING_SIZE] = res;
+    atomic_store_explicit(&g_size_ring_head, head + 1, memory_order_release);
+}
+
+/**
+ * Cache slot for the given identity, probing linearly from the hash
+ */
+static struct size_cache_ent *
+size_cache_slot(dev_t dev, ino_t ino)
+{
+    size_t h = ((size_t)dev * 31 + (size_t)ino) % SIZE_CACHE_SIZE;
+
+    for (size_t k = 0; k < 8; ++k) {
+        struct size_cache_ent *ent = &g_size_cache[(h + k) % SIZE_CACHE_SIZE];
+        if (!ent->used || (ent->dev == dev && ent->ino == ino)) {
+            return ent;
+        }
+    }
+
+    return &g_size_cache[h]; // all probed slots taken: evict the first
+}
+
+/**
+ * Size worker. One thread is enough - the walker underneath already
+ * fans out across WALKER_NTHREADS
+ */
+static void *
+size_worker(void *arg)
+{
+    (void)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&g_size_mtx);
+        while (g_size_njobs == 0) {
+            pthread_cond_wait(&g_size_cond, &g_size_mtx);
+        }
+        unsigned gen          = atomic_load(&g_size_gen);
+        int fd                = g_size_fd;
+        struct size_job *jobs = g_size_jobs;
+        size_t njobs          = g_size_njobs;
+        ++g_size_busy;
+        pthread_mutex_unlock(&g_size_mtx);
+
+        for (size_t i = 0; i < njobs; ++i) {
+            if (atomic_load(&g_size_gen) != gen) {
+                break;
+            }
+
+            struct stat sb;
+            if (fstatat(fd, jobs[i].name, &sb, AT_SYMLINK_NOFOLLOW) < 0 ||
+                !S_ISDIR(sb.st_mode)) {
+                continue;
+            }
+
+            struct size_cache_ent *ent =
+                size_cache_slot(sb.st_dev, sb.st_ino);
+            uint64_t total;
+
+            if (ent->used && ent->dev == sb.st_dev && ent->ino == sb.st_ino &&
+                ent->mtim.tv_sec == sb.st_mtim.tv_sec &&
+                ent->mtim.tv_nsec == sb.st_mtim.tv_nsec) {
+                total = ent->total;
+            } else {
+                struct size_walk sw;
+                atomic_init(&sw.total, 0);
+                walker_run(fd, jobs[i].name, &g_size_walker_ops, &sw);
+                total = atomic_load(&sw.total);
+
+                ent->used  = true;
+                ent->dev   = sb.st_dev;
+                ent->ino   = sb.st_ino;
+                ent->mtim  = sb.st_mtim;
+                ent->total = total;
+            }
+
+            size_ring_push(
+                (struct size_result){
+                    .ino   = jobs[i].ino,
+                    .gen   = gen,
+                    .total = total,
+                },
+                gen);
+
+            // poke the event loop so the result shows up right away
+            ssize_t ignored = write(g_wake_pipe[1], "", 1);
+            (void)ignored;
+        }
+
+        pthread_mutex_lock(&g_size_mtx);
+        if (jobs == g_size_jobs) {
+            g_size_njobs = 0; // batch finished and nothing newer replaced it
+        }
+        --g_size_busy;
+        pthread_cond_broadcast(&g_size_cond);
+        pthread_mutex_unlock(&g_size_mtx);
+    }
+
+    return NULL;
+}
+
+/**
+ * Hands every directory still lacking a total to the size worker.
+ * Mirrors stat_pool_post: cancel the old batch, queue the new one
+ */
+static void
+size_pool_post(const struct dirlist *dl)
+{
+    if (!g_size_started) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, size_worker, NULL) != 0) {
+            return; // the column just stays empty
+        }
+        pthread_detach(thread);
+        g_size_started = true;
+    }
+
+    pthread_mutex_lock(&g_size_mtx);
+
+    atomic_fetch_add(&g_size_gen, 1);
+    g_size_njobs = 0;
+    while (g_size_busy > 0) {
+        pthread_cond_wait(&g_size_cond, &g_size_mtx);
+    }
+
+    free(g_size_jobs);
+    g_size_jobs = NULL;
+    if (g_size_fd >= 0) {
+        close(g_size_fd);
+        g_size_fd = -1;
+    }
+
+    size_t npending = 0;
+    for (size_t i = 0; i < dl->n; ++i) {
+        if (dl->type[i] == TYPE_DIR && !(dl->flags[i] & ENT_SIZE_DONE) &&
+            dl->ino[i] != 0) {
+            ++npending;
+        }
+    }
+
+    if (npending == 0 || g_dirfd < 0) {
+        pthread_mutex_unlock(&g_size_mtx);
+        return;
+    }
+
+    g_size_jobs = malloc(npending * sizeof(*g_size_jobs));
+    if (!g_size_jobs) {
+        pthread_mutex_unlock(&g_size_mtx);
+        return;
+    }
+
+    size_t j = 0;
+    for (size_t i = 0; i < dl->n; ++i) {
+        if (dl->type[i] != TYPE_DIR || (dl->flags[i] & ENT_SIZE_DONE) ||
+            dl->ino[i] == 0) {
+            continue;
+        }
+        g_size_jobs[j].ino = dl->ino[i];
+        strcpy(g_size_jobs[j].name, ent_name(dl, i));
+        ++j;
+    }
+
+    g_size_fd = dup(g_dirfd);
+    if (g_size_fd < 0) {
+        free(g_size_jobs);
+        g_size_jobs = NULL;
+        pthread_mutex_unlock(&g_size_mtx);
+        return;
+    }
+
+    g_size_njobs = npending;
+    pthread_cond_broadcast(&g_size_cond);
+    pthread_mutex_unlock(&g_size_mtx);
+}
+
+/**
+ * Drops whatever batch is queued or running
+ */
+static void
+size_pool_cancel(void)
+{
+    pthread_mutex_lock(&g_size_mtx);
+    atomic_fetch_add(&g_size_gen, 1);
+    g_size_njobs = 0;
+    pthread_mutex_unlock(&g_size_mtx);
+}
+
+/**
+ * Merges finished totals back into the listing. Returns whether anything
+ * changed, i.e. whether a repaint is due
+ */
+static bool
+size_pool_drain(struct dirlist *dl)
+{
+    unsigned gen  = atomic_load(&g_size_gen);
+    bool applied  = false;
+    unsigned tail = atomic_load_explicit(&g_size_ring_tail,
+                                         memory_order_relaxed);
+
+    while (tail != atomic_load_explicit(&g_size_ring_head,
+                                        memory_order_acquire)) {
+        struct size_result res = g_size_ring[tail % SIZE_RING_SIZE];
+        atomic_store_explicit(&g_size_ring_tail, ++tail,
+                              memory_order_release);
+
+        if (res.gen != gen) {
+            continue;
+        }
+
+        // find the entry wherever it sits now; one linear pass per
+        // finished directory is nothing next to the walk it took
+        size_t idx = dl->n;
+        for (size_t i = 0; i < dl->n; ++i) {
+            if (dl->ino[i] == res.ino) {
+                idx = i;
+                break;
+            }
+        }
+        if (idx == dl->n || (dl->flags[idx] & ENT_SIZE_DONE)) {
+            continue;
+        }
+        dl->size[idx] = res.total;
+        dl->flags[idx] |= ENT_SIZE_DONE;
+        applied = true;
+    }
+
+    return applied;
+}
+
+/**
+ * Columns the listing may use: everything, or the left half when the
+ * preview pane has the right
+ */
+static int
+list_cols(void)
+{
+    return g_preview ? g_col / 2 - 1 : g_col;
+}
+
+/**
+ * Columns left for a name after the cursor, the mark and the size column
+ */
+static void
+update_name_cols(void)
+{
+    int cols    = list_cols() - 3 - (g_show_sizes ? 6 : 0);
+    g_name_cols = cols > 0 ? cols : 0;
+}
+
+/**
+ * Sets the terminal size on g_row
+ */
+static bool
+get_term_size(void)
+{
+    struct winsize wsize;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &wsize) < 0) {
+        perror("ioctl");
+        return false;
+    }
+
+    g_row = wsize.ws_row;
+    g_col = wsize.ws_col;
+    update_name_cols();
+
+    return true;
+}
+
+static int g_wake_pipe[2] = {-1, -1};
+
+/**
+ * Used as SIGWINCH (terminal resize handler). Only pokes the self-pipe;
+ * the actual ioctl and relayout happen in the event loop, where they're
+ * safe
+ */
+static void
+handle_winch(int sig)
+{
+    signal(sig, SIG_IGN);
+    if (g_wake_pipe[1] >= 0) {
+        ssize_t ignored = write(g_wake_pipe[1], "", 1);
+        (void)ignored;
+    }
+    signal(sig, handle_winch);
+}
+
+/**
+ * Preview pane ('i'): the file under the cursor is mmap'd and prefaulted
+ * by a worker thread, capped at PREVIEW_CAP bytes, and the draw path
+ * renders the mapping as text lines or a hex dump. The request slot is
+ * latest-wins, so holding j through multi-GB files queues no backlog and
+ * never blocks input; results come back through the wake pipe like any
+ * other worker. The mapping is only replaced under the lock, which the
+ * draw path also holds while reading it
+ */
+static pthread_mutex_t g_prev_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_prev_cond = PTHREAD_COND_INITIALIZER;
+static bool g_prev_started;
+
+static char g_prev_req_name[NAME_MAX + 1];
+static int g_prev_req_fd = -1; // dup'd dir of the request, -1 for none
+static uint64_t g_prev_req_ino;
+static uint64_t g_prev_req_dev;
+
+static uint64_t g_prev_ino; // identity of the published mapping
+static uint64_t g_prev_dev;
+static char *g_prev_map;
+static size_t g_prev_len; // usable bytes, capped at PREVIEW_CAP
+static bool g_prev_binary;
+static bool g_prev_fail; // unreadable, or not a regular file
+
+static void *
+preview_worker(void *arg)
+{
+    (void)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&g_prev_mtx);
+        while (g_prev_req_fd < 0) {
+            pthread_cond_wait(&g_prev_cond, &g_prev_mtx);
+        }
+        char name[NAME_MAX + 1];
+        strcpy(name, g_prev_req_name);
+        int dirfd     = g_prev_req_fd;
+        uint64_t ino  = g_prev_req_ino;
+        uint64_t dev  = g_prev_req_dev;
+        g_prev_req_fd = -1;
+        pthread_mutex_unlock(&g_prev_mtx);
+
+        char *map   = NULL;
+        size_t len  = 0;
+        bool binary = false;
+        bool fail   = true;
+
+        int fd = openat(dirfd, name, O_RDONLY);
+        close(dirfd);
+        if (fd >= 0) {
+            struct stat sb;
+            if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode)) {
+                fail = false;
+                len  = (uint64_t)sb.st_size < PREVIEW_CAP
+                    ? (size_t)sb.st_size
+                    : PREVIEW_CAP;
+                if (len > 0) {
+                    map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (map == MAP_FAILED) {
+                        map  = NULL;
+                        len  = 0;
+                        fail = true;
+                    }
+                }
+            }
+            close(fd);
+        }
+
+        if (map) {
+            // fault the pages in here so the draw path never waits on
+            // I/O, then sniff for the null byte every pager looks for
+            unsigned touch = 0;
+            for (size_t at = 0; at < len; at += 4096) {
+                touch += (unsigned char)map[at];
+            }
+            (void)touch;
+            binary = memchr(map, '\0', len < 4096 ? len : 4096) != NULL;
+        }
+
+        pthread_mutex_lock(&g_prev_mtx);
+        if (g_prev_map) {
+            munmap(g_prev_map, g_prev_len);
+        }
+        g_prev_map    = map;
+        g_prev_len    = len;
+        g_prev_binary = binary;
+        g_prev_fail   = fail;
+        g_prev_ino    = ino;
+        g_prev_dev    = dev;
+        pthread_mutex_unlock(&g_prev_mtx);
+
+        if (g_wake_pipe[1] >= 0) {
+            ssize_t ignored = write(g_wake_pipe[1], "", 1);
+            (void)ignored;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Asks the worker for entry i's contents. Whatever is already published
+ * or pending for the same file is kept
+ */
+static void
+preview_want(const struct dirlist *dl, size_t i)
+{
+    if (!g_prev_started) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, preview_worker, NULL) != 0) {
+            return;
+        }
+        pthread_detach(thread);
+        g_prev_started = true;
+    }
+
+    if (g_dirfd < 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_prev_mtx);
+
+    uint64_t ino = dl->ino[i];
+    if ((g_prev_ino == ino && g_prev_dev == g_dir_dev) ||
+        (g_prev_req_fd >= 0 && g_prev_req_ino == ino &&
+         g_prev_req_dev == g_dir_dev)) {
+        pthread_mutex_unlock(&g_prev_mtx);
+        return;
+    }
+
+    int fd = dup(g_dirfd);
+    if (fd < 0) {
+        pthread_mutex_unlock(&g_prev_mtx);
+        return;
+    }
+    if (g_prev_req_fd >= 0) {
+        close(g_prev_req_fd); // superseded before it was picked up
+    }
+    g_prev_req_fd  = fd;
+    g_prev_req_ino = ino;
+    g_prev_req_dev = g_dir_dev;
+    strcpy(g_prev_req_name, ent_name(dl, i));
+    pthread_cond_broadcast(&g_prev_cond);
+    pthread_mutex_unlock(&g_prev_mtx);
+}
+
+/**
+ * A growable byte buffer, used for the outgoing frame and for composing
+ * single screen rows
+ */
+struct strbuf {
+    char *buf;
+    size_t len;
+    size_t cap;
+};
+
+static struct strbuf g_frame;
+
+/**
+ * Makes room for at least extra more bytes
+ */
+static void
+sb_reserve(struct strbuf *sb, size_t extra)
+{
+    if (sb->len + extra <= sb->cap) {
+        return;
+    }
+
+    size_t cap = sb->cap ? sb->cap * 2 : 4096;
+    while (sb->len + extra > cap) {
+        cap *= 2;
+    }
+
+    char *buf = realloc(sb->buf, cap);
+    if (!buf) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    sb->buf = buf;
+    sb->cap = cap;
+}
+
+/**
+ * Appends raw bytes
+ */
+static void
+sb_write(struct strbuf *sb, const char *data, size_t len)
+{
+    sb_reserve(sb, len);
+    memcpy(sb->buf + sb->len, data, len);
+    sb->len += len;
+}
+
+/**
+ * Appends a string
+ */
+static void
+sb_puts(struct strbuf *sb, const char *s)
+{
+    sb_write(sb, s, strlen(s));
+}
+
+/**
+ * Appends a formatted string
+ */
+static void
+sb_printf(struct strbuf *sb, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    int need = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+
+    if (need < 0) {
+        return;
+    }
+
+    sb_reserve(sb, (size_t)need + 1);
+
+    va_start(ap, fmt);
+    vsnprintf(sb->buf + sb->len, (size_t)need + 1, fmt, ap);
+    va_end(ap);
+
+    sb->len += (size_t)need;
+}
+
+/**
+ * Byte-wise equality of two buffers
+ */
+static bool
+sb_eq(const struct strbuf *a, const struct strbuf *b)
+{
+    if (a->len != b->len) {
+        return false;
+    }
+    // an untouched row has a NULL buf; don't hand that to memcmp
+    return a->len == 0 || memcmp(a->buf, b->buf, a->len) == 0;
+}
+
+/**
+ * Appends a string to the current frame
+ */
+static void
+fb_puts(const char *s)
+{
+    sb_puts(&g_frame, s);
+}
+
+/**
+ * Appends a formatted string to the current frame
+ */
+static void
+fb_printf(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    int need = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+
+    if (need < 0) {
+        return;
+    }
+
+    sb_reserve(&g_frame, (size_t)need + 1);
+
+    va_start(ap, fmt);
+    vsnprintf(g_frame.buf + g_frame.len, (size_t)need + 1, fmt, ap);
+    va_end(ap);
+
+    g_frame.len += (size_t)need;
+}
+
+/**
+ * Pushes the composed frame to the terminal with one write per frame
+ * (modulo partial writes)
+ */
+static void
+fb_flush(void)
+{
+    size_t off = 0;
+    while (off < g_frame.len) {
+        INSTR_COUNT(n_write);
+        ssize_t written =
+            write(STDOUT_FILENO, g_frame.buf + off, g_frame.len - off);
+        if (written < 0) {
+            break;
+        }
+        INSTR_ADD(wr_bytes, (uint64_t)written);
+        off += (size_t)written;
+    }
+
+    g_frame.len = 0;
+}
+
+/**
+ * The double-buffered screen: cur is the frame being composed, prev is
+ * what the terminal currently shows. Row 0 is the status line, rows 2+
+ * hold directory entries (matching the terminal scroll region)
+ */
+#define SCR_TOP 2 // first entry row, 0-based
+
+static struct {
+    struct strbuf *cur;
+    struct strbuf *prev;
+    int nrows;
+    bool full; // force a full repaint on the next flush
+} g_scr;
+
+/**
+ * Starts composing a new frame, adapting to terminal resizes
+ */
+static void
+scr_begin(void)
+{
+    int nrows = g_row > 0 ? g_row : 1;
+
+    if (nrows != g_scr.nrows) {
+        for (int i = nrows; i < g_scr.nrows; ++i) {
+            free(g_scr.cur[i].buf);
+            free(g_scr.prev[i].buf);
+        }
+
+        struct strbuf *cur  = realloc(g_scr.cur, nrows * sizeof(*cur));
+        struct strbuf *prev = realloc(g_scr.prev, nrows * sizeof(*prev));
+        if (!cur || !prev) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = g_scr.nrows; i < nrows; ++i) {
+            cur[i]  = (struct strbuf){0};
+            prev[i] = (struct strbuf){0};
+        }
+
+        g_scr.cur   = cur;
+        g_scr.prev  = prev;
+        g_scr.nrows = nrows;
+        g_scr.full  = true;
+    }
+
+    for (int i = 0; i < g_scr.nrows; ++i) {
+        g_scr.cur[i].len = 0;
+    }
+}
+
+/**
+ * Row buffer for 0-based row y of the frame under composition. Rows that
+ * don't fit the terminal (think a two-line tmux pane) land in a scratch
+ * buffer the flush never looks at
+ */
+static struct strbuf *
+scr_row(int y)
+{
+    static struct strbuf discard;
+
+    if (y < 0 || y >= g_scr.nrows) {
+        discard.len = 0;
+        return &discard;
+    }
+
+    return &g_scr.cur[y];
+}
+
+/**
+ * Looks for a pure vertical shift of the entry area between prev and cur.
+ * Returns the shift (positive: content moved up) or 0
+ */
+static int
+scr_find_scroll(void)
+{
+    int top = SCR_TOP;
+    int bot = g_scr.nrows - 1;
+
+    for (int k = 1; k <= (bot - top + 1) / 2; ++k) {
+        bool up       = true;
+        bool down     = true;
+        bool nonempty = false;
+
+        for (int i = top; i + k <= bot; ++i) {
+            if (up && !sb_eq(&g_scr.cur[i], &g_scr.prev[i + k])) {
+                up = false;
+            }
+            if (down && !sb_eq(&g_scr.cur[i + k], &g_scr.prev[i])) {
+                down = false;
+            }
+            if (g_scr.cur[i].len > 0) {
+                nonempty = true;
+            }
+            if (!up && !down) {
+                break;
+            }
+        }
+
+        if (nonempty && up) {
+            return k;
+        }
+        if (nonempty && down) {
+            return -k;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Diffs the composed frame against the previous one and appends only the
+ * changed parts to the outgoing frame buffer. Pure viewport shifts become
+ * a single scroll sequence plus the newly exposed rows
+ */
+static void
+scr_flush(void)
+{
+    if (g_scr.full) {
+        fb_printf(
+            "\033[2J"     // clear screen
+            "\033[3;%dr", // reset scrolling area
+            g_row);
+
+        for (int i = 0; i < g_scr.nrows; ++i) {
+            if (g_scr.cur[i].len > 0) {
+                fb_printf("\033[%d;1H", i + 1);
+                sb_write(&g_frame, g_scr.cur[i].buf, g_scr.cur[i].len);
+            }
+        }
+
+        g_scr.full = false;
+    } else {
+        int shift = scr_find_scroll();
+
+        if (shift > 0) {
+            // content moved up: scroll the region, recycle prev rows
+            fb_printf("\033[%dS", shift);
+            for (int i = SCR_TOP; i + shift < g_scr.nrows; ++i) {
+                struct strbuf tmp     = g_scr.prev[i];
+                g_scr.prev[i]         = g_scr.prev[i + shift];
+                g_scr.prev[i + shift] = tmp;
+                g_scr.prev[i + shift].len = 0;
+            }
+        } else if (shift < 0) {
+            fb_printf("\033[%dT", -shift);
+            for (int i = g_scr.nrows - 1; i + shift >= SCR_TOP; --i) {
+                struct strbuf tmp     = g_scr.prev[i];
+                g_scr.prev[i]         = g_scr.prev[i + shift];
+                g_scr.prev[i + shift] = tmp;
+                g_scr.prev[i + shift].len = 0;
+            }
+        }
+
+        for (int i = 0; i < g_scr.nrows; ++i) {
+            if (!sb_eq(&g_scr.cur[i], &g_scr.prev[i])) {
+                fb_printf("\033[%d;1H", i + 1);
+                sb_write(&g_frame, g_scr.cur[i].buf, g_scr.cur[i].len);
+                fb_puts("\033[0m\033[K"); // wipe whatever the row held before
+            }
+        }
+    }
+
+    struct strbuf *tmp = g_scr.prev;
+    g_scr.prev         = g_scr.cur;
+    g_scr.cur          = tmp;
+}
+
+/**
+ * Resets the terminal to it's prior state
+ */
+static void
+restore_terminal(void)
+{
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &g_old_termios) < 0) {
+        perror("tcsetattr");
+    }
+
+    fb_puts(
+        "\033[?7h"    // enable line wrapping
+        "\033[?25h"   // unhide cursor
+        "\033[;r"     // reset scroll region
+        "\033[?1049l" // restore main screen
+    );
+    fb_flush();
+}
+
+/**
+ * Sets up the terminal for TUI use (read every char, differentiate \r and \n,
+ * don't echo, hide the cursor, fix a scroll region, switch to a second screen)
+ */
+static bool
+setup_terminal(void)
+{
+    if (tcgetattr(STDIN_FILENO, &g_old_termios) < 0) {
+        perror("tcgetattr");
+        return false;
+    }
+
+    struct termios raw = g_old_termios;
+    raw.c_oflag &= ~OPOST;
+    raw.c_lflag &= ~(ECHO | ICANON);
+
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) < 0) {
+        perror("tcsetattr");
+        return false;
+    }
+
+    fb_printf(
+        "\033[?1049h" // use alternative screen buffer
+        "\033[?7l"    // diable line wrapping
+        "\033[?25l"   // hide cursor
+        "\033[2J"     // clear screen
+        "\033[3;%dr", // limit scrolling to scrolling area
+        g_row);
+    fb_flush();
+
+    g_scr.full = true; // whatever we knew about the screen is gone
+
+    return true;
+}
+
+/**
+ * Spill pager for directories too large to hold in memory. Once a scan
+ * passes PAGER_RUN_ENTS entries the getdents stream is broken into
+ * name-sorted runs appended to an unlinked temp file, the runs are merged
+ * once into a flat sorted spill, and the listing holds a single
+ * PAGER_PAGE_ENTS-sized page of it at a time. Memory stays bounded by one
+ * run regardless of directory size, and any page - including the last -
+ * is one pread away. Paged listings always use plain name order (mtime or
+ * size order would mean a stat per entry) and ignore inotify updates
+ * until a manual reload
+ */
+struct pager {
+    bool active;
+    int fd;             // merged spill, unlinked
+    uint64_t end;       // its size
+    size_t total;       // entries across all pages
+    uint64_t *page_off; // spill offset of each page's first record
+    size_t npages;
+    size_t page;        // page currently loaded into the listing
+    int run_fd;         // sorted runs, unlinked; closed after the merge
+    uint64_t *run_off;  // start of each run in run_fd
+    size_t nruns;
+};
+
+static struct pager g_pager = {
+    .fd     = -1,
+    .run_fd = -1,
+};
+
+/**
+ * On-disk entry: fixed header, then the name including its NUL. Cached
+ * metadata is not spilled; the flags for it are stripped so a loaded page
+ * refetches on demand like any other listing
+ */
+struct spill_rec {
+    uint64_t ino;
+    uint8_t type;
+    uint8_t flags;
+    uint16_t namelen; // including the terminating NUL
+};
+
+struct spill_wr {
+    int fd;
+    uint64_t off; // flushed file position
+    size_t len;
+    char buf[DENTS_BUF_SIZE];
+};
+
+static struct spill_wr g_spill_wr;
+
+static void
+spill_flush(struct spill_wr *wr)
+{
+    size_t done = 0;
+    while (done < wr->len) {
+        ssize_t w = write(wr->fd, wr->buf + done, wr->len - done);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write"); // can't page without the spill
+            exit(EXIT_FAILURE);
+        }
+        done += (size_t)w;
+    }
+
+    wr->off += wr->len;
+    wr->len = 0;
+}
+
+static void
+spill_write(struct spill_wr *wr, const void *p, size_t n)
+{
+    const char *src = p;
+    while (n > 0) {
+        if (wr->len == sizeof(wr->buf)) {
+            spill_flush(wr);
+        }
+
+        size_t take = sizeof(wr->buf) - wr->len;
+        if (take > n) {
+            take = n;
+        }
+        memcpy(wr->buf + wr->len, src, take);
+        wr->len += take;
+        src += take;
+        n -= take;
+    }
+}
+
+/**
+ * Buffered positioned reader over a [pos, end) window of the spill
+ */
+struct spill_rd {
+    int fd;
+    uint64_t pos; // next unread file offset
+    uint64_t end;
+    size_t len; // buffered bytes
+    size_t at;  // cursor within the buffer
+    char buf[PAGER_RD_BUF];
+};
+
+static bool
+spill_read(struct spill_rd *rd, void *p, size_t n)
+{
+    char *out = p;
+    while (n > 0) {
+        if (rd->at == rd->len) {
+            uint64_t left = rd->end - rd->pos;
+            if (left == 0) {
+                return false;
+            }
+
+            size_t want =
+                left < sizeof(rd->buf) ? (size_t)left : sizeof(rd->buf);
+            ssize_t r = pread(rd->fd, rd->buf, want, (off_t)rd->pos);
+            if (r <= 0) {
+                if (r < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+
+            rd->pos += (uint64_t)r;
+            rd->len = (size_t)r;
+            rd->at  = 0;
+        }
+
+        size_t take = rd->len - rd->at;
+        if (take > n) {
+            take = n;
+        }
+        memcpy(out, rd->buf + rd->at, take);
+        rd->at += take;
+        out += take;
+        n -= take;
+    }
+
+    return true;
+}
+
+static int
+pager_tmpfile(void)
+{
+    char tmpl[PATH_MAX];
+    snprintf(
+        tmpl, sizeof(tmpl), "%s/filet.XXXXXX", getenv_or("TMPDIR", "/tmp"));
+
+    int fd = mkstemp(tmpl);
+    if (fd >= 0) {
+        unlink(tmpl);
+    }
+    return fd;
+}
+
+/**
+ * Drops all pager state; every fresh directory scan starts from this
+ */
+static void
+pager_reset(void)
+{
+    if (g_pager.fd >= 0) {
+        close(g_pager.fd);
+    }
+    if (g_pager.run_fd >= 0) {
+        close(g_pager.run_fd);
+    }
+    free(g_pager.page_off);
+    free(g_pager.run_off);
+
+    memset(&g_pager, 0, sizeof(g_pager));
+    g_pager.fd     = -1;
+    g_pager.run_fd = -1;
+}
+
+/**
+ * Sorts the run buffer by name and appends it to the run file as one
+ * sorted run, then empties the buffer for the next stretch of the stream.
+ * The first spill is what switches the scan into paged operation
+ */
+static void
+pager_spill_run(struct dirlist *dl)
+{
+    if (g_pager.run_fd < 0) {
+        g_pager.run_fd = pager_tmpfile();
+        if (g_pager.run_fd < 0) {
+            perror("mkstemp");
+            exit(EXIT_FAILURE);
+        }
+
+        g_spill_wr.fd  = g_pager.run_fd;
+        g_spill_wr.off = 0;
+        g_spill_wr.len = 0;
+        g_pager.active = true;
+    }
+
+    enum sortmode mode = g_sort_mode;
+    bool reverse       = g_sort_reverse;
+    g_sort_mode        = SORT_NAME;
+    g_sort_reverse     = false;
+    dirlist_sort(dl);
+    g_sort_mode    = mode;
+    g_sort_reverse = reverse;
+
+    uint64_t *off = realloc(
+        g_pager.run_off, (g_pager.nruns + 1) * sizeof(*g_pager.run_off));
+    if (!off) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    g_pager.run_off            = off;
+    g_pager.run_off[g_pager.nruns++] = g_spill_wr.off;
+
+    for (size_t i = 0; i < dl->n; ++i) {
+        const char *name     = ent_name(dl, i);
+        struct spill_rec rec = {
+            .ino   = dl->ino[i],
+            .type  = dl->type[i],
+            .flags = dl->flags[i] &
+                (uint8_t)~(ENT_META_DONE | ENT_SIZE_DONE),
+            .namelen = (uint16_t)(strlen(name) + 1),
+        };
+        spill_write(&g_spill_wr, &rec, sizeof(rec));
+        spill_write(&g_spill_wr, name, rec.namelen);
+    }
+    spill_flush(&g_spill_wr);
+
+    g_pager.total += dl->n;
+    dirlist_clear(dl);
+}
+
+struct merge_src {
+    struct spill_rd rd;
+    struct spill_rec rec; // decoded head record of the run
+    char name[NAME_MAX + 1];
+    bool eof;
+};
+
+static void
+merge_advance(struct merge_src *s)
+{
+    if (!spill_read(&s->rd, &s->rec, sizeof(s->rec)) ||
+        s->rec.namelen == 0 || s->rec.namelen > sizeof(s->name) ||
+        !spill_read(&s->rd, s->name, s->rec.namelen)) {
+        s->eof = true;
+    }
+}
+
+static bool
+merge_less(const struct merge_src *a, const struct merge_src *b)
+{
+    bool a_dir = a->rec.type == TYPE_DIR || a->rec.type == TYPE_SYML_TO_DIR;
+    bool b_dir = b->rec.type == TYPE_DIR || b->rec.type == TYPE_SYML_TO_DIR;
+
+    if (a_dir != b_dir) {
+        return a_dir;
+    }
+
+    return (g_natural_sort ? natcmp(a->name, b->name)
+                           : strcmp(a->name, b->name)) < 0;
+}
+
+static void
+merge_sift(struct merge_src *src, size_t *heap, size_t nheap, size_t i)
+{
+    for (;;) {
+        size_t l   = 2 * i + 1;
+        size_t r   = 2 * i + 2;
+        size_t min = i;
+
+        if (l < nheap && merge_less(&src[heap[l]], &src[heap[min]])) {
+            min = l;
+        }
+        if (r < nheap && merge_less(&src[heap[r]], &src[heap[min]])) {
+            min = r;
+        }
+        if (min == i) {
+            break;
+        }
+
+        size_t tmp = heap[i];
+        heap[i]    = heap[min];
+        heap[min]  = tmp;
+        i          = min;
+    }
+}
+
+/**
+ * Single-pass k-way merge of the sorted runs into the flat spill, noting
+ * the offset of every page's first record so pages load with one pread
+ */
+static void
+pager_finish(void)
+{
+    size_t nruns          = g_pager.nruns;
+    struct merge_src *src = malloc(nruns * sizeof(*src));
+    size_t *heap          = malloc(nruns * sizeof(*heap));
+    if (!src || !heap) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < nruns; ++i) {
+        src[i].rd.fd  = g_pager.run_fd;
+        src[i].rd.pos = g_pager.run_off[i];
+        src[i].rd.end =
+            i + 1 < nruns ? g_pager.run_off[i + 1] : g_spill_wr.off;
+        src[i].rd.len = 0;
+        src[i].rd.at  = 0;
+        src[i].eof    = false;
+        merge_advance(&src[i]);
+    }
+
+    size_t nheap = 0;
+    for (size_t i = 0; i < nruns; ++i) {
+        if (!src[i].eof) {
+            heap[nheap++] = i;
+        }
+    }
+    for (size_t i = nheap / 2; i-- > 0;) {
+        merge_sift(src, heap, nheap, i);
+    }
+
+    g_pager.fd = pager_tmpfile();
+    if (g_pager.fd < 0) {
+        perror("mkstemp");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t npages =
+        (g_pager.total + PAGER_PAGE_ENTS - 1) / PAGER_PAGE_ENTS;
+    g_pager.page_off = malloc(npages * sizeof(*g_pager.page_off));
+    if (!g_pager.page_off) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    g_spill_wr.fd  = g_pager.fd;
+    g_spill_wr.off = 0;
+    g_spill_wr.len = 0;
+
+    size_t nout = 0;
+    while (nheap > 0) {
+        struct merge_src *s = &src[heap[0]];
+
+        if (nout % PAGER_PAGE_ENTS == 0) {
+            g_pager.page_off[nout / PAGER_PAGE_ENTS] =
+                g_spill_wr.off + g_spill_wr.len;
+        }
+        spill_write(&g_spill_wr, &s->rec, sizeof(s->rec));
+        spill_write(&g_spill_wr, s->name, s->rec.namelen);
+        ++nout;
+
+        merge_advance(s);
+        if (s->eof) {
+            heap[0] = heap[--nheap];
+        }
+        merge_sift(src, heap, nheap, 0);
+    }
+    spill_flush(&g_spill_wr);
+
+    free(src);
+    free(heap);
+    free(g_pager.run_off);
+    g_pager.run_off = NULL;
+    g_pager.nruns   = 0;
+    close(g_pager.run_fd);
+    g_pager.run_fd = -1;
+
+    g_pager.end    = g_spill_wr.off;
+    g_pager.total  = nout;
+    g_pager.npages = (nout + PAGER_PAGE_ENTS - 1) / PAGER_PAGE_ENTS;
+}
+
+/**
+ * Loads one page of the merged spill into the listing and re-applies the
+ * view filters
+ */
+static void
+pager_load_page(struct dirlist *dl, size_t page, bool show_hidden)
+{
+    struct spill_rd rd = {
+        .fd  = g_pager.fd,
+        .pos = g_pager.page_off[page],
+        .end = page + 1 < g_pager.npages ? g_pager.page_off[page + 1]
+                                         : g_pager.end,
+    };
+
+    size_t first = page * PAGER_PAGE_ENTS;
+    size_t count = g_pager.total - first;
+    if (count > PAGER_PAGE_ENTS) {
+        count = PAGER_PAGE_ENTS;
+    }
+
+    dirlist_clear(dl);
+    for (size_t i = 0; i < count; ++i) {
+        struct spill_rec rec;
+        char name[NAME_MAX + 1];
+
+        if (!spill_read(&rd, &rec, sizeof(rec)) || rec.namelen == 0 ||
+            rec.namelen > sizeof(name) ||
+            !spill_read(&rd, name, rec.namelen)) {
+            break;
+        }
+
+        dirlist_push(dl, name, rec.type, rec.flags);
+        dl->ino[dl->n - 1] = rec.ino;
+    }
+
+    g_pager.page = page;
+    view_refresh(dl, show_hidden);
+    // types and exec bits resolve per viewport at the next repaint
+}
+
+/**
+ * Moves to an adjacent page, skipping pages whose whole view filters away.
+ * Returns false at either end of the spill, with the page it started on
+ * loaded again - never stranding the view on an all-hidden page
+ */
+static bool
+pager_step(struct dirlist *dl, int dir, bool show_hidden)
+{
+    size_t start = g_pager.page;
+    size_t page  = start;
+
+    for (;;) {
+        if (dir > 0 ? page + 1 >= g_pager.npages : page == 0) {
+            if (g_pager.page != start) {
+                pager_load_page(dl, start, show_hidden);
+            }
+            return false;
+        }
+
+        page = dir > 0 ? page + 1 : page - 1;
+        pager_load_page(dl, page, show_hidden);
+        if (dl->nview > 0) {
+            return true;
+        }
+    }
+}
+
+/**
+ * One cached, already sorted directory listing. The cache owns both the
+ * dirlist buffers and the directory fd; eviction reuses them
+ */
+struct dircache_ent {
+    bool used;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtim;
+    int fd;
+    struct dirlist dl;
+    size_t sel; // cursor position when the dir was last shown
+    size_t y;
+    uint64_t stamp; // LRU tick of the last access
+};
+
+static struct dircache_ent g_dircache[DIR_CACHE_SIZE];
+static int g_dircache_cur = -1;
+static uint64_t g_dircache_tick;
+
+static int g_inotify_fd = -1;
+static int g_inotify_wd = -1;
+
+static char *g_user_and_hostname; // status line prefix, built at startup
+
+static void redraw(
+    struct dirlist *dl,
+    const char *user_and_hostname,
+    const char *path,
+    size_t sel,
+    size_t offset);
+
+/**
+ * Remembers the cursor position in the currently shown directory, so
+ * coming back to it through the cache restores the view
+ */
+static void
+dircache_save_cursor(size_t sel, size_t y)
+{
+    if (g_dircache_cur >= 0) {
+        g_dircache[g_dircache_cur].sel = sel;
+        g_dircache[g_dircache_cur].y   = y;
+    }
+}
+
+static struct dirlist g_empty_dl; // returned for unreadable directories
+
+/**
+ * Read the directory open on fd, by way of the LRU cache; the fd's
+ * ownership passes to the cache. path is only used to (re)arm the
+ * inotify watch - that API has no *at variant.
+ *
+ * A cache hit (same dev/ino/mtime) costs no I/O at all and restores
+ * sel/y; the hidden setting isn't part of the key, a hit just rebuilds
+ * the view for it. Returns a cache-owned listing, never NULL.
+ */
+static struct dirlist *
+read_dir(int fd, const char *path, bool show_hidden, size_t *sel, size_t *y)
+{
+    static char buf[DENTS_BUF_SIZE];
+
+    *sel = 0;
+    *y   = 0;
+
+    pager_reset(); // any spill belongs to the directory we're leaving
+    g_meta_wait.dl = NULL; // likewise any deferred resort
+
+    if (fd < 0) {
+        g_dircache_cur = -1;
+        g_dirfd        = -1;
+        return &g_empty_dl;
+    }
+
+    // the fd may have been dup'd mid-stream (reload) or scanned before
+    lseek(fd, 0, SEEK_SET);
+
+    // watch the new current directory for incremental updates
+    if (g_inotify_fd >= 0) {
+        if (g_inotify_wd >= 0) {
+            inotify_rm_watch(g_inotify_fd, g_inotify_wd);
+        }
+        g_inotify_wd = inotify_add_watch(
+            g_inotify_fd,
+            path,
+            IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+    }
+
+    struct stat dsb = {0};
+    if (fstat(fd, &dsb) < 0) {
+        dsb.st_mtim.tv_sec = -1; // never matches, forces a rescan next time
+    }
+
+    int slot = -1;
+    for (int i = 0; i < DIR_CACHE_SIZE; ++i) {
+        if (g_dircache[i].used && g_dircache[i].dev == dsb.st_dev &&
+            g_dircache[i].ino == dsb.st_ino) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot >= 0 &&
+        g_dircache[slot].mtim.tv_sec == dsb.st_mtim.tv_sec &&
+        g_dircache[slot].mtim.tv_nsec == dsb.st_mtim.tv_nsec) {
+        // hit: the fd we just opened is redundant
+        close(fd);
+
+        struct dircache_ent *e = &g_dircache[slot];
+        e->stamp               = ++g_dircache_tick;
+        g_dircache_cur         = slot;
+        g_dirfd                = e->fd;
+        g_dir_dev              = (uint64_t)e->dev;
+        *sel                   = e->sel;
+        *y                     = e->y;
+
+        dirlist_rebuild_view(&e->dl, show_hidden);
+        return &e->dl; // still-unstatted rows repost from the draw path
+    }
+
+    if (slot < 0) {
+        // evict the least recently used slot
+        for (int i = 0; i < DIR_CACHE_SIZE; ++i) {
+            if (!g_dircache[i].used) {
+                slot = i;
+                break;
+            }
+            if (slot < 0 || g_dircache[i].stamp < g_dircache[slot].stamp) {
+                slot = i;
+            }
+        }
+    }
+
+    struct dircache_ent *e = &g_dircache[slot];
+    if (e->used && e->fd >= 0) {
+        close(e->fd);
+    }
+
+    e->used  = true;
+    e->dev   = dsb.st_dev;
+    e->ino   = dsb.st_ino;
+    e->mtim  = dsb.st_mtim;
+    e->fd    = fd;
+    e->sel         = 0;
+    e->y           = 0;
+    e->stamp       = ++g_dircache_tick;
+
+    struct dirlist *dl = &e->dl;
+    dirlist_clear(dl);
+
+    g_dircache_cur = slot;
+    g_dirfd        = fd;
+    g_dir_dev      = (uint64_t)dsb.st_dev;
+
+    size_t batches = 0;
+    INSTR_TIMER(it_scan);
+
+    for (;;) {
+        INSTR_COUNT(n_getdents);
+        ssize_t nread = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (nread <= 0) {
+            break; // on error treat the directory as exhausted
+        }
+
+        // streaming first paint: once it's clear the scan spans more than
+        // one batch, show the first screenful (unsorted) right away and
+        // keep the entry count ticking while the rest streams in. The
+        // sorted result reconciles the view when the scan finishes
+        ++batches;
+        if (batches == 2 || (batches & 0xff) == 0) {
+            dirlist_rebuild_view(dl, show_hidden);
+            redraw(dl, g_user_and_hostname, path, 0, 0);
+            fb_flush();
+        }
+
+        for (ssize_t pos = 0; pos < nread;) {
+            struct linux_dirent64 *ent = (struct linux_dirent64 *)(buf + pos);
+            const char *name           = ent->d_name;
+            struct stat sb;
+
+            pos += ent->d_reclen;
+
+            if (name[0] == '.' &&
+                (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+
+            uint8_t type;
+            uint8_t flags = name[0] == '.' ? ENT_HIDDEN : 0;
+
+            switch (ent->d_type) {
+            case DT_DIR:
+                type = TYPE_DIR;
+                flags |= ENT_STAT_DONE;
+                break;
+            case DT_LNK:
+                // whether the target is a dir resolves when it's visible
+                type = TYPE_SYML;
+                break;
+            case DT_REG:
+                // only the exec bit is missing; fetched when visible
+                type = TYPE_NORM;
+                break;
+            default:
+                // DT_UNKNOWN: stat now, dir-ness decides the sort order
+                INSTR_COUNT(n_stat);
+                if (fstatat(fd, name, &sb, AT_SYMLINK_NOFOLLOW) < 0) {
+                    continue;
+                }
+
+                flags |= ENT_STAT_DONE | ENT_META_DONE;
+
+                if (S_ISDIR(sb.st_mode)) {
+                    type = TYPE_DIR;
+                } else if (S_ISLNK(sb.st_mode)) {
+                    type = TYPE_SYML;
+                    flags &= ~ENT_STAT_DONE;
+                } else if (sb.st_mode & S_IXUSR) {
+                    type = TYPE_EXEC;
+                    flags |= ENT_SIZE_DONE;
+                } else {
+                    type = TYPE_NORM;
+                    flags |= ENT_SIZE_DONE;
+                }
+                break;
+            }
+
+            dirlist_push(dl, name, type, flags);
+            dl->ino[dl->n - 1] = ent->d_ino;
+            if (flags & ENT_META_DONE) {
+                dl->mtime[dl->n - 1] = mtime_ns(&sb);
+            }
+            if (flags & ENT_SIZE_DONE) {
+                dl->size[dl->n - 1] = (uint64_t)sb.st_size;
+            }
+
+            if (dl->n >= PAGER_RUN_ENTS) {
+                pager_spill_run(dl); // too many to keep; go paged
+            }
+        }
+    }
+
+    INSTR_STAGE(scan_ns, it_scan);
+
+    if (g_pager.active) {
+        if (dl->n > 0) {
+            pager_spill_run(dl);
+        }
+        INSTR_TIMER(it_merge);
+        pager_finish();
+        INSTR_STAGE(sort_ns, it_merge);
+
+        // a single page can't stand in for the whole directory, so make
+        // sure a revisit never counts as a cache hit
+        e->mtim.tv_sec = -1;
+
+        pager_load_page(dl, 0, show_hidden);
+        if (dl->nview == 0) {
+            // the first page may be all dotfiles; start on one that shows
+            pager_step(dl, 1, show_hidden);
+        }
+        return dl;
+    }
+
+    INSTR_TIMER(it_sort);
+    dirlist_sort(dl);
+    INSTR_STAGE(sort_ns, it_sort);
+    dirlist_rebuild_view(dl, show_hidden);
+
+    return dl;
+}
+
+enum {
+    INOTIFY_NONE,
+    INOTIFY_CHANGED,
+    INOTIFY_OVERFLOW, // queue overflowed, only a full rescan helps
+};
+
+/**
+ * Drains the inotify fd and applies creations and removals as in-place
+ * updates of the sorted listing, O(changes) instead of a full rescan.
+ * The caller rebuilds the view and re-anchors the cursor afterwards
+ */
+static int
+inotify_apply(struct dirlist *dl)
+{
+    char buf[4096];
+    int ret = INOTIFY_NONE;
+
+    if (g_pager.active) {
+        // the listing is mostly on disk and can't be patched in place;
+        // drain the events and stay stale until a manual reload
+        while (read(g_inotify_fd, buf, sizeof(buf)) > 0) {
+        }
+        return INOTIFY_NONE;
+    }
+
+    for (;;) {
+        ssize_t nread = read(g_inotify_fd, buf, sizeof(buf));
+        if (nread <= 0) {
+            break;
+        }
+
+        for (ssize_t pos = 0; pos < nread;) {
+            struct inotify_event *ev = (struct inotify_event *)(buf + pos);
+            pos += sizeof(*ev) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                return INOTIFY_OVERFLOW;
+            }
+
+            if (ev->len == 0) {
+                continue;
+            }
+
+            const char *name = ev->name;
+            bool is_dir      = ev->mask & IN_ISDIR;
+
+            if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                if (dirlist_find(dl, name, is_dir) >= 0) {
+                    continue; // already known
+                }
+
+                uint8_t type  = is_dir ? TYPE_DIR : TYPE_NORM;
+                uint8_t flags = is_dir ? ENT_STAT_DONE : 0;
+                if (name[0] == '.') {
+                    flags |= ENT_HIDDEN;
+                }
+
+                // stat up front: identity keeps a pre-existing mark
+                // sticking, and metadata places it under any sort order
+                struct stat sb;
+                uint64_t mtime = 0;
+                uint64_t size  = 0;
+                uint64_t ino   = 0;
+                INSTR_COUNT(n_stat);
+                if (g_dirfd >= 0 &&
+                    fstatat(g_dirfd, name, &sb, AT_SYMLINK_NOFOLLOW) == 0) {
+                    mtime = mtime_ns(&sb);
+                    ino   = (uint64_t)sb.st_ino;
+                    flags |= ENT_META_DONE;
+                    if (!is_dir) {
+                        size = (uint64_t)sb.st_size;
+                        flags |= ENT_SIZE_DONE;
+                    }
+                }
+                dirlist_insert_sorted(dl, name, type, flags, mtime, size);
+
+                ssize_t at = dirlist_find(dl, name, is_dir);
+                if (at >= 0) {
+                    dl->ino[at] = ino;
+                }
+                ret = INOTIFY_CHANGED;
+            } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                ssize_t at = dirlist_find(dl, name, is_dir);
+                if (at < 0) {
+                    continue;
+                }
+
+                dirlist_remove(dl, (size_t)at);
+                ret = INOTIFY_CHANGED;
+            }
+        }
+    }
+
+    if (ret == INOTIFY_CHANGED && g_dircache_cur >= 0 && g_dirfd >= 0) {
+        // keep the cache entry valid: it now reflects the new mtime
+        struct stat sb;
+        if (fstat(g_dirfd, &sb) == 0) {
+            g_dircache[g_dircache_cur].mtim = sb.st_mtim;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Spawns a new process, waits for it and returns
+ */
+static void
+spawn(const char *path, const char *cmd, const char *argv1)
+{
+    int status;
+    pid_t pid = fork();
+
+    if (pid < 0) {
+        return;
+    }
+
+    restore_terminal();
+
+    if (pid == 0) {
+        if (chdir(path) < 0) {
+            _exit(EXIT_FAILURE);
+        }
+        execlp(cmd, cmd, argv1, NULL);
+        // NOTREACHED
+        _exit(EXIT_FAILURE);
+    } else {
+        do {
+            waitpid(pid, &status, WUNTRACED);
+        } while (!WIFEXITED(status) && !WIFSIGNALED(status));
+    }
+
+    setup_terminal();
+}
+
+/**
+ * Whether a sort by mtime or size would see every entry. Most entries
+ * carry cached metadata already; when some don't, the switch defers to
+ * the stat pool instead of stalling the UI on a stat-per-entry loop
+ */
+static bool
+dirlist_meta_complete(const struct dirlist *dl)
+{
+    for (size_t i = 0; i < dl->n; ++i) {
+        if (!(dl->flags[i] & ENT_META_DONE)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Completes the classification of an entry whose type couldn't be derived
+ * from d_type alone. Synchronous fallback for commands that need the final
+ * type before the stat pool has delivered it
+ */
+static void
+resolve_entry(struct dirlist *dl, size_t i)
+{
+    if ((dl->flags[i] & ENT_STAT_DONE) || g_dirfd < 0) {
+        return;
+    }
+
+    struct stat meta = {0};
+
+    dl->flags[i] |= ENT_STAT_DONE;
+    dl->type[i] =
+        (uint8_t)stat_classify(g_dirfd, ent_name(dl, i), dl->type[i], &meta);
+    if (meta.st_mode != 0) {
+        dl->mtime[i] = mtime_ns(&meta);
+        dl->flags[i] |= ENT_META_DONE;
+        if (dl->type[i] != TYPE_DIR) {
+            dl->size[i] = (uint64_t)meta.st_size;
+            dl->flags[i] |= ENT_SIZE_DONE;
+        }
+    }
+}
+
+/**
+ * Formats a byte count the way du -h would (at most five columns)
+ */
+static void
+fmt_size(uint64_t n, char out[8])
+{
+    static const char units[] = "BKMGTPE";
+    double v                  = (double)n;
+    int u                     = 0;
+
+    while (v >= 1000.0 && units[u + 1]) {
+        v /= 1024.0;
+        ++u;
+    }
+
+    if (u == 0) {
+        snprintf(out, 8, "%uB", (unsigned)n); // n < 1000 here
+    } else if (v >= 10.0) {
+        snprintf(out, 8, "%.0f%c", v, units[u]);
+    } else {
+        snprintf(out, 8, "%.1f%c", v, units[u]);
+    }
+}
+
+/**
+ * Picks the escape sequence for an entry's color. With LS_COLORS the
+ * suffix lookup already happened at ingest; this just selects the right
+ * precompiled sequence for the resolved type
+ */
+static const char *
+ent_color_seq(struct dirlist *dl, size_t i)
+{
+    if (g_colors_on) {
+        uint16_t c = COLOR_NONE;
+        switch (dl->type[i]) {
+        case TYPE_DIR:
+            c = g_color_di;
+            break;
+        case TYPE_SYML: // FALLTHROUGH
+        case TYPE_SYML_TO_DIR:
+            c = g_color_ln;
+            break;
+        case TYPE_EXEC:
+            c = g_color_ex != COLOR_NONE ? g_color_ex : dl->color[i];
+            break;
+        case TYPE_NORM:
+            c = dl->color[i] != COLOR_NONE ? dl->color[i] : g_color_fi;
+            break;
+        }
+        return c == COLOR_NONE ? "\033[0m" : g_color_arena + c;
+    }
+
+    switch (dl->type[i]) {
+    case TYPE_DIR:
+        return "\033[34;1m";
+    case TYPE_SYML: // FALLTHROUGH
+    case TYPE_SYML_TO_DIR:
+        return "\033[36;1m";
+    case TYPE_EXEC:
+        return "\033[32;1m";
+    }
+    return "\033[0m";
+}
+
+/**
+ * Composes a single directory entry into a row buffer
+ */
+static void
+draw_line(struct strbuf *sb, struct dirlist *dl, size_t i, bool is_sel)
+{
+    sb_puts(sb, ent_color_seq(dl, i));
+
+    bool marked = mark_has(g_dir_dev, dl->ino[i]);
+
+    if (g_show_sizes) {
+        char size[8] = "?";
+        if (dl->flags[i] & ENT_SIZE_DONE) {
+            fmt_size(dl->size[i], size);
+        }
+        sb_printf(
+            sb,
+            "%c %c%5s ",
+            is_sel ? '>' : ' ',
+            marked ? '*' : ' ',
+            size);
+    } else {
+        sb_printf(sb, "%c %c", is_sel ? '>' : ' ', marked ? '*' : ' ');
+    }
+
+    // the truncation point was measured at ingest, so wide characters
+    // never straddle the right edge and the copy is a fixed byte range
+    sb_write(sb, ent_name(dl, i), dl->dtrunc[i]);
+}
+
+/**
+ * Name columns of one grid cell: the widest name in the listing, capped
+ * to what a single row could show
+ */
+static size_t
+grid_namew(const struct dirlist *dl)
+{
+    size_t namew = dl->wmax > 0 ? dl->wmax : 1;
+    if (g_name_cols > 0 && namew > (size_t)g_name_cols) {
+        namew = (size_t)g_name_cols;
+    }
+    return namew;
+}
+
+/**
+ * Entries per grid row: cell markers and a gap add three columns on top
+ * of the name. One column means the grid degenerates into the normal
+ * listing, which is also what j/k movement falls back to
+ */
+static size_t
+grid_ncols(const struct dirlist *dl)
+{
+    size_t ncols = (size_t)list_cols() / (grid_namew(dl) + 3);
+    return ncols > 0 ? ncols : 1;
+}
+
+/**
+ * Composes one grid cell, padded to the cell width so the next cell
+ * lines up. Only names wider than the cell pay for a remeasure; the
+ * common case reuses the width from ingest
+ */
+static void
+draw_cell(
+    struct strbuf *sb,
+    struct dirlist *dl,
+    size_t i,
+    bool is_sel,
+    size_t namew)
+{
+    sb_puts(sb, ent_color_seq(dl, i));
+    sb_printf(
+        sb,
+        "%c%c",
+        is_sel ? '>' : ' ',
+        mark_has(g_dir_dev, dl->ino[i]) ? '*' : ' ');
+
+    const char *name = ent_name(dl, i);
+    size_t len       = strlen(name);
+    uint16_t w       = dl->dwidth[i];
+    uint16_t fit     = (uint16_t)len;
+    if (w > namew) {
+        utf8_measure(name, len, namew, &w, &fit);
+        // a double-width character on the edge can leave the prefix a
+        // column short; remeasure it so the padding lines up exactly
+        utf8_measure(name, fit, namew, &w, &fit);
+    }
+    sb_write(sb, name, fit);
+
+    for (size_t pad = w; pad < namew + 1; ++pad) {
+        sb_write(sb, " ", 1);
+    }
+}
+
+/**
+ * Renders the preview pane into the entry rows: a separator, then the
+ * mapped bytes as text lines or a hex dump. Runs under the preview lock
+ * so the worker can't replace the mapping mid-draw; the pane blanks
+ * while the selected file's mapping hasn't arrived yet
+ */
+static void
+preview_draw(struct dirlist *dl, size_t sel)
+{
+    size_t px    = (size_t)g_col / 2; // separator column, 0-based
+    size_t panew = (size_t)g_col > px + 2 ? (size_t)g_col - px - 2 : 0;
+    size_t rows  = (size_t)g_row > 2 ? (size_t)g_row - 2 : 0;
+
+    uint32_t ei  = dl->nview > 0 ? dl->view[sel] : 0;
+    bool is_file = dl->nview > 0 && dl->type[ei] != TYPE_DIR &&
+        dl->type[ei] != TYPE_SYML_TO_DIR;
+
+    pthread_mutex_lock(&g_prev_mtx);
+
+    bool have = is_file && g_prev_ino == dl->ino[ei] &&
+        g_prev_dev == g_dir_dev && !g_prev_fail;
+    const char *at  = g_prev_map;
+    const char *end = g_prev_map + g_prev_len;
+
+    for (size_t r = 0; r < rows; ++r) {
+        struct strbuf *sb = scr_row(SCR_TOP + (int)r);
+
+        // erase the listing's leftovers, then jump to the pane
+        sb_printf(sb, "\033[K\033[%zuG\033[0m|", px + 1);
+
+        if (!have || panew == 0) {
+            continue;
+        }
+
+        if (g_prev_binary) {
+            size_t off = r * 16;
+            if (off >= g_prev_len) {
+                continue;
+            }
+            size_t take = g_prev_len - off < 16 ? g_prev_len - off : 16;
+
+            sb_printf(sb, " %06zx ", off);
+            for (size_t b = 0; b < take; ++b) {
+                sb_printf(
+                    sb, "%02x%s", (unsigned char)g_prev_map[off + b],
+                    b % 2 ? " " : "");
+            }
+            for (size_t b = take; b < 16; ++b) {
+                sb_puts(sb, b % 2 ? "   " : "  ");
+            }
+            for (size_t b = 0; b < take; ++b) {
+                char c = g_prev_map[off + b];
+                sb_write(sb, isprint((unsigned char)c) ? &c : ".", 1);
+            }
+        } else {
+            if (at >= end) {
+                continue;
+            }
+
+            const char *nl = memchr(at, '\n', (size_t)(end - at));
+            size_t linelen = nl ? (size_t)(nl - at) : (size_t)(end - at);
+
+            uint16_t w;
+            uint16_t fit;
+            utf8_measure(at, linelen, panew, &w, &fit);
+
+            // control bytes would corrupt the frame; print them as dots
+            char line[1024];
+            if (fit > sizeof(line)) {
+                fit = sizeof(line);
+            }
+            for (size_t b = 0; b < fit; ++b) {
+                unsigned char c = (unsigned char)at[b];
+                line[b] = c == '\t' ? ' ' : c < 0x20 || c == 0x7f ? '.' : (char)c;
+            }
+            sb_write(sb, " ", 1);
+            sb_write(sb, line, fit);
+
+            at = nl ? nl + 1 : end;
+        }
+    }
+
+    pthread_mutex_unlock(&g_prev_mtx);
+}
+
+#ifdef FILET_INSTRUMENT
+
+/**
+ * One status bar segment with the latest stage timings and the syscall
+ * totals; draw shows the previous frame, the current one isn't done yet
+ */
+static void
+instr_overlay(void)
+{
+    char scan[16];
+    char sort[16];
+    char draw[16];
+    instr_fmt_ns(atomic_load(&g_instr.scan_ns), scan, sizeof(scan));
+    instr_fmt_ns(atomic_load(&g_instr.sort_ns), sort, sizeof(sort));
+    instr_fmt_ns(atomic_load(&g_instr.draw_ns), draw, sizeof(draw));
+
+    sb_printf(
+        scr_row(0),
+        " \033[35;1m[scan %s sort %s draw %s | stat %llu gd %llu wr %lluK]"
+        "\033[0m",
+        scan,
+        sort,
+        draw,
+        (unsigned long long)atomic_load(&g_instr.n_stat),
+        (unsigned long long)atomic_load(&g_instr.n_getdents),
+        (unsigned long long)(atomic_load(&g_instr.wr_bytes) / 1024));
+}
+
+#endif
+
+/**
+ * Composes the whole screen and hands it to the diff renderer. Unchanged
+ * rows cost nothing on the wire, so this is cheap to call for any update
+ */
+static void
+redraw(
+    struct dirlist *dl,
+    const char *user_and_hostname,
+    const char *path,
+    size_t sel,
+    size_t offset)
+{
+    size_t n = dl->nview;
+    INSTR_TIMER(it_draw);
+
+    if (dl->n > 0 && dl->trunc_cols != (uint16_t)g_name_cols) {
+        dirlist_retrunc(dl); // terminal width or size column changed
+    }
+
+    scr_begin();
+
+    sb_printf(
+        scr_row(0),
+        "%s"             // print username@hostname
+        "\033[34;1m%s"   // print path
+        " \033[0m[%zu]", // number of entries
+        user_and_hostname,
+        path,
+        n);
+
+    if (g_pager.active) {
+        sb_printf(
+            scr_row(0),
+            " \033[0m[page %zu/%zu, %zu entries]",
+            g_pager.page + 1,
+            g_pager.npages,
+            g_pager.total);
+    }
+
+    if (atomic_load(&g_del_active)) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (double)(now.tv_sec - g_del_start.tv_sec) +
+            (double)(now.tv_nsec - g_del_start.tv_nsec) / 1e9;
+        size_t files = atomic_load(&g_del_files);
+
+        sb_printf(
+            scr_row(0),
+            " \033[31;1m[deleting %zu/%zu, %zu files, %.0f/s]\033[0m",
+            atomic_load(&g_del_done),
+            g_del_total,
+            files,
+            elapsed > 0.0 ? (double)files / elapsed : 0.0);
+    }
+
+    if (g_search_mode || g_search[0] != '\0') {
+        sb_printf(
+            scr_row(0),
+            " \033[33;1m/%s%s\033[0m",
+            g_search,
+            g_search_mode ? "_" : "");
+    }
+
+    if (atomic_load(&g_cp_active)) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (double)(now.tv_sec - g_cp_start.tv_sec) +
+            (double)(now.tv_nsec - g_cp_start.tv_nsec) / 1e9;
+        double mb = (double)atomic_load(&g_cp_bytes) / 1e6;
+
+        sb_printf(
+            scr_row(0),
+            " \033[33;1m[pasting %zu/%zu, %zu files, %.0f MB/s]\033[0m",
+            atomic_load(&g_cp_done),
+            g_cp_total,
+            atomic_load(&g_cp_files),
+            elapsed > 0.0 ? mb / elapsed : 0.0);
+    }
+
+    if (g_quit_armed &&
+        (atomic_load(&g_del_active) || atomic_load(&g_cp_active))) {
+        sb_printf(
+            scr_row(0),
+            " \033[31;1m[job running - q again to abandon it]\033[0m");
+    }
+
+    INSTR_OVERLAY();
+
+    if (n == 0) {
+        sb_puts(scr_row(SCR_TOP), "\033[31;7mdirectory empty\033[27m");
+    } else if (g_grid) {
+        size_t namew = grid_namew(dl);
+        size_t ncols = grid_ncols(dl);
+
+        // offset arrives as sel - y; in grid mode y counts grid rows
+        size_t yrow = sel - offset;
+        if (yrow > sel / ncols) {
+            yrow = sel / ncols;
+        }
+        size_t toprow = sel / ncols - yrow;
+
+        for (size_t v = toprow * ncols; v < n; ++v) {
+            size_t r = v / ncols - toprow;
+            if (r >= (size_t)g_row - 2) {
+                break;
+            }
+            draw_cell(scr_row(SCR_TOP + (int)r), dl, dl->view[v],
+                      v == sel, namew);
+        }
+        stat_pool_want(dl, toprow * ncols,
+                       (toprow + (size_t)g_row - 2) * ncols);
+    } else {
+        for (size_t v = offset; v < n && v - offset < (size_t)g_row - 2; ++v) {
+            draw_line(
+                scr_row(SCR_TOP + (int)(v - offset)),
+                dl,
+                dl->view[v],
+                v == sel);
+        }
+        stat_pool_want(dl, offset, offset + (size_t)g_row - 2);
+    }
+
+    if (g_preview) {
+        preview_draw(dl, sel);
+        if (n > 0 && dl->type[dl->view[sel]] != TYPE_DIR) {
+            preview_want(dl, dl->view[sel]);
+        }
+    }
+
+    scr_flush();
+    INSTR_DRAW(it_draw);
+}
+
+#ifndef FILET_BENCH
+
+/**
+ * Daemon mode (filet -d): a background server owning the directory cache.
+ * Client invocations connect over a UNIX socket, hand over their start
+ * directory and terminal, and block while the daemon runs the session on
+ * that terminal. Cached listings, sort results and stat data survive from
+ * one session to the next, so the quit/cd/relaunch loop of the shell
+ * wrapper reopens even a huge directory instantly. The quit directory and
+ * selection ride the socket back to the client, which writes the usual
+ * /tmp files for the wrapper. One session runs at a time; marks, the yank
+ * clipboard and view settings persist between sessions like any other
+ * cached state
+ */
+static int g_session_sock = -1; // daemon's client socket during a session
+
+static char g_quit_dir[PATH_MAX];                // where 'q' happened
+static char g_quit_sel[PATH_MAX + NAME_MAX + 2]; // what it happened on
+
+static void
+filet_socket_path(char *out, size_t cap)
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    if (dir) {
+        snprintf(out, cap, "%s/filet.sock", dir);
+    } else {
+        snprintf(out, cap, "/tmp/filet.%u.sock", (unsigned)getuid());
+    }
+}
+
+/**
+ * Writes the quit directory and selection where the shell wrapper looks
+ */
+static void
+write_quit_state(void)
+{
+    FILE *f = fopen("/tmp/filet_dir", "w");
+    if (f) {
+        fprintf(f, "%s\n", g_quit_dir);
+        fclose(f);
+    }
+
+    f = fopen("/tmp/filet_sel", "w");
+    if (f) {
+        if (g_quit_sel[0] != '\0') {
+            fprintf(f, "%s\n", g_quit_sel);
+        }
+        fclose(f);
+    }
+}
+
+/**
+ * Builds the colored user@hostname: prefix of the status line
+ */
+static void
+make_user_and_hostname(void)
+{
+    const char *user = getlogin();
+    if (!user) {
+        user = getenv_or("USER", "?"); // daemons have no login tty
+    }
+
+    char hostname[HOST_NAME_MAX];
+    if (gethostname(hostname, sizeof(hostname)) < 0) {
+        perror("gethostname");
+        strcpy(hostname, "?");
+    }
+
+    g_user_and_hostname = malloc(
+        strlen(user) + strlen(hostname) + strlen("\033[32;1m@\033[0m:") + 1);
+    if (!g_user_and_hostname) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    strcpy(g_user_and_hostname, "\033[32;1m");
+    strcat(g_user_and_hostname, user);
+    strcat(g_user_and_hostname, "@");
+    strcat(g_user_and_hostname, hostname);
+    strcat(g_user_and_hostname, "\033[0m:");
+}
+
+/**
+ * One interactive session, first paint to quit. The terminal behind
+ * stdin/stdout must already be raw. Fills g_quit_dir/g_quit_sel on a 'q'
+ * quit and leaves them empty when the session is abandoned (an attached
+ * client went away)
+ */
+static void
+run_session(char *path)
+{
+    const char *editor = getenv_or("EDITOR", "vi");
+    const char *shell  = getenv_or("SHELL", "/bin/sh");
+    const char *home   = getenv_or("HOME", "/");
+
+    g_quit_dir[0] = '\0';
+    g_quit_sel[0] = '\0';
+    g_quit_armed  = false; // each session confirms for itself
+
+    struct dirlist *dl = &g_empty_dl;
+
+    bool show_hidden = false;
+    bool fetch_dir   = true;
+    int next_fd      = open(path, O_RDONLY | O_DIRECTORY);
+    size_t sel       = 0;
+    size_t y         = 0;
+    size_t n;
+
+    // dup'd fds of the ancestors of the current directory, nearest last;
+    // 'h' pops one instead of re-resolving the whole path
+    int *nav_stack   = NULL;
+    size_t nav_n     = 0;
+    size_t nav_cap   = 0;
+
+    for (;;) {
+        if (fetch_dir) {
+            fetch_dir = false;
+            g_search[0]   = '\0'; // narrowing doesn't follow dir changes
+            g_search_mode = false;
+            dircache_save_cursor(sel, y);
+            if (next_fd < 0 && g_dirfd >= 0) {
+                next_fd = dup(g_dirfd); // plain reload of the current dir
+            }
+            dl      = read_dir(next_fd, path, show_hidden, &sel, &y);
+            next_fd = -1;
+            n       = dl->nview;
+
+            // a restored cursor may not fit the current listing or window
+            if (n == 0) {
+                sel = 0;
+            } else if (sel >= n) {
+                sel = n - 1;
+            }
+            if (y > sel) {
+                y = sel;
+            }
+            if (y > (size_t)g_row - 3) {
+                y = (size_t)g_row - 3;
+            }
+
+            if (g_show_sizes) {
+                size_pool_post(dl);
+            }
+            redraw(dl, g_user_and_hostname, path, sel, sel - y);
+        }
+
+        bool statted = stat_pool_drain(dl);
+
+        if (g_meta_wait.dl &&
+            (g_meta_wait.dl != dl ||
+             atomic_load(&g_stat_gen) != g_meta_wait.gen)) {
+            g_meta_wait.dl = NULL; // the listing or batch moved on
+        } else if (g_meta_wait.dl && stat_pool_idle()) {
+            // the backfill has landed; now run the deferred resort
+            stat_pool_drain(dl); // results pushed after the drain above
+            g_meta_wait.dl = NULL;
+            dirlist_sort(dl);
+            view_refresh(dl, show_hidden);
+            n       = dl->nview;
+            sel     = 0;
+            y       = 0;
+            statted = true;
+        }
+
+        if (size_pool_drain(dl) || statted) {
+            redraw(dl, g_user_and_hostname, path, sel, sel - y);
+        }
+        fb_flush();
+
+        struct pollfd pfds[4];
+        pfds[0] = (struct pollfd){.fd = STDIN_FILENO, .events = POLLIN};
+        pfds[1] = (struct pollfd){.fd = g_inotify_fd, .events = POLLIN};
+        pfds[2] = (struct pollfd){.fd = g_wake_pipe[0], .events = POLLIN};
+        nfds_t nfds = g_inotify_fd >= 0 ? 3 : 1;
+
+        if (g_inotify_fd < 0) {
+            pfds[1] = pfds[2];
+            nfds    = 2;
+        }
+
+        nfds_t wake_at = nfds - 1;
+        if (g_session_sock >= 0) {
+            pfds[nfds++] =
+                (struct pollfd){.fd = g_session_sock, .events = POLLIN};
+        }
+
+        bool busy = atomic_load(&g_del_active) || atomic_load(&g_cp_active);
+        int nready = poll(pfds, nfds, busy ? 200 : -1);
+        if (nready < 0) {
+            continue; // EINTR; the signal shows up on the self-pipe
+        }
+
+        if (nready == 0) {
+            if (atomic_load(&g_del_active) || atomic_load(&g_cp_active)) {
+                // progress tick for the status line
+                redraw(dl, g_user_and_hostname, path, sel, sel - y);
+            } else {
+                fetch_dir = true; // the background job finished, resync
+            }
+            continue;
+        }
+
+        if (pfds[wake_at].revents & POLLIN) {
+            // resize, or a worker poking us: drain, remeasure, relayout
+            // (finished totals get merged at the top of the loop)
+            char drain[16];
+            while (read(g_wake_pipe[0], drain, sizeof(drain)) > 0) {
+            }
+            get_term_size();
+
+            if (y > (size_t)g_row - 3) {
+                y = (size_t)g_row - 3;
+            }
+            redraw(dl, g_user_and_hostname, path, sel, sel - y);
+
+            if (!(pfds[0].revents & POLLIN)) {
+                continue;
+            }
+        }
+
+        if (g_session_sock >= 0 &&
+            (pfds[nfds - 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+            // a byte is the client forwarding a resize; EOF is the client
+            // going away, which abandons the session without quit state
+            char b[16];
+            if (read(g_session_sock, b, sizeof(b)) <= 0) {
+                goto quit;
+            }
+            get_term_size();
+
+            if (y > (size_t)g_row - 3) {
+                y = (size_t)g_row - 3;
+            }
+            redraw(dl, g_user_and_hostname, path, sel, sel - y);
+
+            if (!(pfds[0].revents & POLLIN)) {
+                continue;
+            }
+        }
+
+        if (g_inotify_fd >= 0 && (pfds[1].revents & POLLIN)) {
+            char keep[NAME_MAX + 1] = "";
+            if (n > 0) {
+                strcpy(keep, ent_name(dl, dl->view[sel]));
+            }
+
+            int changed = inotify_apply(dl);
+
+            if (changed == INOTIFY_OVERFLOW) {
+                fetch_dir = true;
+            } else if (changed == INOTIFY_CHANGED) {
+                // entries moved under any batch the pool is working on;
+                // a pending meta backfill restarts on the new indices
+                bool refill = g_meta_wait.dl != NULL;
+                stat_pool_invalidate();
+                if (refill) {
+                    stat_pool_post_meta(dl);
+                }
+
+                // keep the cursor on the same entry if it's still there
+                view_refresh(dl, show_hidden);
+                n   = dl->nview;
+                sel = view_find(dl, keep);
+                if (y > sel) {
+                    y = sel;
+                }
+                redraw(dl, g_user_and_hostname, path, sel, sel - y);
+            }
+
+            if (!(pfds[0].revents & POLLIN)) {
+                continue;
+            }
+        }
+
+        // drain everything the terminal has queued up - under key repeat
+        // that's whole runs of j/k - and repaint once at the end, so
+        // scrolling tracks the repeat rate instead of falling behind it
+        unsigned char keys[256];
+        ssize_t nkeys = read(STDIN_FILENO, keys, sizeof(keys));
+        if (nkeys <= 0) {
+            continue;
+        }
+
+        bool dirty       = false;
+        bool meta_refill = false; // resorting under a meta backfill
+
+        // keys after a directory change were aimed at a listing that's
+        // gone; drop them rather than replaying them against the new one
+        for (ssize_t ki = 0; ki < nkeys && !fetch_dir; ++ki) {
+            int c = keys[ki];
+
+            if (g_search_mode) {
+                if (c == '\r' || c == '\n') {
+                    g_search_mode = false; // accept, narrowing stays
+                } else if (c == 27) {
+                    g_search_mode = false;
+                    g_search[0]   = '\0';
+                } else if (c == 127 || c == '\b') {
+                    size_t len = strlen(g_search);
+                    if (len > 0) {
+                        g_search[len - 1] = '\0';
+                    } else {
+                        g_search_mode = false;
+                    }
+                } else if (isprint(c) &&
+                           strlen(g_search) < sizeof(g_search) - 1) {
+                    size_t len        = strlen(g_search);
+                    g_search[len]     = (char)c;
+                    g_search[len + 1] = '\0';
+                }
+
+                view_refresh(dl, show_hidden);
+                n     = dl->nview;
+                sel   = 0;
+                y     = 0;
+                dirty = true;
+                continue;
+            }
+
+            if (c != 'q') {
+                g_quit_armed = false; // abandoning takes two q's in a row
+            }
+
+            switch (c) {
+            case 'h':
+                if (g_grid && n > 0 && sel % grid_ncols(dl) != 0) {
+                    --sel; // same grid row, one cell left
+                    dirty = true;
+                    break;
+                }
+                if (nav_n > 0) {
+                    next_fd = nav_stack[--nav_n]; // parent fd already open
+                } else if (g_dirfd >= 0) {
+                    next_fd = openat(g_dirfd, "..", O_RDONLY | O_DIRECTORY);
+                } else {
+                    char parent[PATH_MAX];
+                    strcpy(parent, path);
+                    next_fd = open(dirname(parent), O_RDONLY | O_DIRECTORY);
+                }
+                if (next_fd < 0) {
+                    break; // can't reach the parent: keep the listing,
+                           // and crucially the path it's labeled with
+                }
+                dirname(path);
+                fetch_dir = true;
+                break;
+            case '~':
+                next_fd = open(home, O_RDONLY | O_DIRECTORY);
+                if (next_fd < 0) {
+                    break; // stay put
+                }
+                while (nav_n > 0) {
+                    close(nav_stack[--nav_n]); // the old ancestry is moot
+                }
+                strcpy(path, home);
+                fetch_dir = true;
+                break;
+            case '/':
+                g_search_mode = true;
+                g_search[0]   = '\0';
+                view_refresh(dl, show_hidden);
+                n     = dl->nview;
+                sel   = 0;
+                y     = 0;
+                dirty = true;
+                break;
+            case '.': {
+                char keep[NAME_MAX + 1] = "";
+                if (n > 0) {
+                    strcpy(keep, ent_name(dl, dl->view[sel]));
+                }
+
+                show_hidden = !show_hidden;
+                dirlist_rebuild_view(dl, show_hidden);
+                n   = dl->nview;
+                sel = view_find(dl, keep);
+                if (y > sel) {
+                    y = sel;
+                }
+                dirty = true;
+                break;
+            }
+            case 'r':
+                fetch_dir = true;
+                break;
+            case 'i':
+                g_preview = !g_preview;
+                update_name_cols();
+                dirty = true;
+                break;
+            case 'c':
+                g_grid = !g_grid;
+                if (n > 0) {
+                    size_t row = g_grid ? sel / grid_ncols(dl) : sel;
+                    y = row < (size_t)g_row - 3 ? row : (size_t)g_row - 3;
+                }
+                dirty = true;
+                break;
+            case 'd':
+                g_show_sizes = !g_show_sizes;
+                update_name_cols();
+                if (g_show_sizes) {
+                    size_pool_post(dl);
+                } else {
+                    size_pool_cancel();
+                }
+                dirty = true;
+                break;
+            case 'v':
+                if (g_pager.active) {
+                    break; // paged listings are fixed in spill order
+                }
+                g_natural_sort = !g_natural_sort;
+                meta_refill = g_meta_wait.dl != NULL;
+                stat_pool_invalidate(); // the resort moves every index
+                dirlist_sort(dl);
+                view_refresh(dl, show_hidden);
+                if (meta_refill) {
+                    stat_pool_post_meta(dl);
+                }
+                n     = dl->nview;
+                sel   = 0;
+                y     = 0;
+                dirty = true;
+                break;
+            case 'o':
+                if (g_pager.active) {
+                    break;
+                }
+                g_sort_mode = (g_sort_mode + 1) % 3;
+                if (g_sort_mode != SORT_NAME && !dirlist_meta_complete(dl)) {
+                    // keep the current order; the resort runs once the
+                    // pool has backfilled the missing metadata
+                    stat_pool_post_meta(dl);
+                    break;
+                }
+                stat_pool_invalidate(); // the resort moves every index
+                dirlist_sort(dl);
+                view_refresh(dl, show_hidden);
+                n     = dl->nview;
+                sel   = 0;
+                y     = 0;
+                dirty = true;
+                break;
+            case 'O':
+                if (g_pager.active) {
+                    break;
+                }
+                g_sort_reverse = !g_sort_reverse;
+                meta_refill = g_meta_wait.dl != NULL;
+                stat_pool_invalidate(); // the resort moves every index
+                dirlist_sort(dl);
+                view_refresh(dl, show_hidden);
+                if (meta_refill) {
+                    stat_pool_post_meta(dl);
+                }
+                n     = dl->nview;
+                sel   = 0;
+                y     = 0;
+                dirty = true;
+                break;
+            case 's':
+                spawn(path, shell, NULL);
+                fetch_dir = true;
+                break;
+            case 'p': // FALLTHROUGH
+            case 'P': {
+                if (g_yank_n == 0 || g_yank_fd < 0 || g_dirfd < 0 ||
+                    atomic_load(&g_cp_active)) {
+                    break; // nothing yanked, or one paste at a time
+                }
+
+                struct cp_job *job = malloc(sizeof(*job));
+                if (!job) {
+                    break;
+                }
+                job->items = malloc(g_yank_n * sizeof(*job->items));
+                job->src_fd = dup(g_yank_fd);
+                job->dst_fd = dup(g_dirfd);
+                if (!job->items || job->src_fd < 0 || job->dst_fd < 0) {
+                    free(job->items);
+                    if (job->src_fd >= 0) {
+                        close(job->src_fd);
+                    }
+                    if (job->dst_fd >= 0) {
+                        close(job->dst_fd);
+                    }
+                    free(job);
+                    break;
+                }
+
+                memcpy(job->items, g_yank_items, g_yank_n * sizeof(*job->items));
+                job->n    = g_yank_n;
+                bool move = c == 'P';
+                job->move = move;
+
+                atomic_store(&g_cp_files, 0);
+                atomic_store(&g_cp_bytes, 0);
+                atomic_store(&g_cp_done, 0);
+                g_cp_total = job->n;
+                clock_gettime(CLOCK_MONOTONIC, &g_cp_start);
+                atomic_store(&g_cp_active, true);
+
+                pthread_t thread;
+                if (pthread_create(&thread, NULL, cp_worker, job) != 0) {
+                    close(job->src_fd);
+                    close(job->dst_fd);
+                    free(job->items);
+                    free(job);
+                    atomic_store(&g_cp_active, false);
+                    break;
+                }
+                pthread_detach(thread);
+
+                if (move) {
+                    // the sources are going away; drop the clipboard
+                    free(g_yank_items);
+                    g_yank_items = NULL;
+                    g_yank_n     = 0;
+                    close(g_yank_fd);
+                    g_yank_fd = -1;
+                }
+
+                dirty = true;
+                break;
+            }
+            case 'q':
+                if (!g_quit_armed && (atomic_load(&g_del_active) ||
+                                      atomic_load(&g_cp_active))) {
+                    // quitting now would abandon the job half-done;
+                    // make it deliberate instead of silent
+                    g_quit_armed = true;
+                    dirty        = true;
+                    break;
+                }
+                strcpy(g_quit_dir, path);
+                if (n > 0) {
+                    snprintf(g_quit_sel, sizeof(g_quit_sel), "%s/%s", path,
+                             ent_name(dl, dl->view[sel]));
+                }
+                goto quit;
+            }
+
+            if (n == 0) {
+                continue; // rest of the commands requires at least one entry
+            }
+
+            switch (c) {
+            case 'j': {
+                // in grid mode j/k move by whole grid rows
+                size_t step = g_grid ? grid_ncols(dl) : 1;
+                if (sel / step < (n - 1) / step) {
+                    sel = sel + step < n ? sel + step : n - 1;
+                    if (y < (size_t)g_row - 3) {
+                        ++y;
+                    }
+                    dirty = true;
+                } else if (g_pager.active && pager_step(dl, 1, show_hidden)) {
+                    n     = dl->nview;
+                    sel   = 0;
+                    y     = 0;
+                    dirty = true;
+                }
+                break;
+            }
+            case 'k': {
+                size_t step = g_grid ? grid_ncols(dl) : 1;
+                if (sel >= step) {
+                    sel -= step;
+                    if (y > 0) {
+                        --y;
+                    }
+                    dirty = true;
+                } else if (g_pager.active && pager_step(dl, -1, show_hidden)) {
+                    n          = dl->nview;
+                    sel        = n - 1;
+                    size_t bot = (n - 1) / (g_grid ? grid_ncols(dl) : 1);
+                    y = bot < (size_t)g_row - 3 ? bot : (size_t)g_row - 3;
+                    dirty = true;
+                }
+                break;
+            }
+            case 'l': {
+                uint32_t ei = dl->view[sel];
+                resolve_entry(dl, ei); // the async answer may not be in yet
+                if (dl->type[ei] != TYPE_DIR &&
+                    dl->type[ei] != TYPE_SYML_TO_DIR) {
+                    size_t ncols = g_grid ? grid_ncols(dl) : 1;
+                    if (sel % ncols != ncols - 1 && sel + 1 < n) {
+                        ++sel; // same grid row, one cell right
+                        dirty = true;
+                    }
+                    break;
+                }
+
+                next_fd = openat(
+                    g_dirfd, ent_name(dl, ei), O_RDONLY | O_DIRECTORY);
+                if (next_fd < 0) {
+                    break; // can't enter it, stay put
+                }
+
+                if (nav_n == nav_cap) {
+                    nav_cap   = nav_cap ? nav_cap * 2 : 16;
+                    nav_stack = realloc(nav_stack, nav_cap * sizeof(*nav_stack));
+                    if (!nav_stack) {
+                        perror("realloc");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                nav_stack[nav_n] = dup(g_dirfd);
+                if (nav_stack[nav_n] >= 0) {
+                    ++nav_n;
+                }
+
+                // don't append to /
+                if (path[1] != '\0') {
+                    strcat(path, "/");
+                }
+                strcat(path, ent_name(dl, ei));
+                fetch_dir = true;
+                break;
+            }
+            case 'g':
+                if (g_pager.active && g_pager.page != 0) {
+                    pager_load_page(dl, 0, show_hidden);
+                    if (dl->nview == 0) {
+                        pager_step(dl, 1, show_hidden);
+                    }
+                    n = dl->nview;
+                }
+                sel = 0;
+                y   = 0;
+                dirty = true;
+                break;
+            case 'G': {
+                if (g_pager.active && g_pager.page != g_pager.npages - 1) {
+                    // the page table makes the last page one seek away
+                    pager_load_page(dl, g_pager.npages - 1, show_hidden);
+                    if (dl->nview == 0) {
+                        pager_step(dl, -1, show_hidden);
+                    }
+                    n = dl->nview;
+                }
+                sel        = n - 1;
+                size_t bot = (n - 1) / (g_grid ? grid_ncols(dl) : 1);
+                y     = bot < (size_t)g_row - 3 ? bot : (size_t)g_row - 3;
+                dirty = true;
+                break;
+            }
+            case 'e':
+                spawn(path, editor, ent_name(dl, dl->view[sel]));
+                fetch_dir = true;
+                break;
+            case 'm':
+                mark_toggle(g_dir_dev, dl->ino[dl->view[sel]]);
+                dirty = true;
+                break;
+            case 'y': {
+                size_t nmarked = 0;
+                for (size_t i = 0; i < dl->n; ++i) {
+                    if (mark_has(g_dir_dev, dl->ino[i])) {
+                        ++nmarked;
+                    }
+                }
+                if (nmarked == 0 || g_dirfd < 0) {
+                    break;
+                }
+
+                struct cp_item *items = malloc(nmarked * sizeof(*items));
+                int fd                = dup(g_dirfd);
+                if (!items || fd < 0) {
+                    free(items);
+                    if (fd >= 0) {
+                        close(fd);
+                    }
+                    break;
+                }
+
+                free(g_yank_items);
+                if (g_yank_fd >= 0) {
+                    close(g_yank_fd);
+                }
+                g_yank_items = items;
+                g_yank_fd    = fd;
+                g_yank_n     = 0;
+
+                for (size_t i = 0; i < dl->n; ++i) {
+                    if (mark_has(g_dir_dev, dl->ino[i])) {
+                        resolve_entry(dl, i); // dir-ness decides how to copy
+                        g_yank_items[g_yank_n].type = dl->type[i];
+                        strcpy(g_yank_items[g_yank_n].name, ent_name(dl, i));
+                        ++g_yank_n;
+                        mark_remove(g_dir_dev, dl->ino[i]);
+                    }
+                }
+
+                dirty = true;
+                break;
+            }
+            case 'x': {
+                if (atomic_load(&g_del_active)) {
+                    break; // one deletion at a time
+                }
+
+                size_t nmarked = 0;
+                for (size_t i = 0; i < dl->n; ++i) {
+                    if (mark_has(g_dir_dev, dl->ino[i])) {
+                        ++nmarked;
+                    }
+                }
+                if (nmarked == 0) {
+                    break;
+                }
+
+                struct del_job *job = malloc(sizeof(*job));
+                if (!job) {
+                    break;
+                }
+                job->items = malloc(nmarked * sizeof(*job->items));
+                if (!job->items) {
+                    free(job);
+                    break;
+                }
+
+                strcpy(job->dir, path);
+                job->n = 0;
+                for (size_t i = 0; i < dl->n; ++i) {
+                    if (mark_has(g_dir_dev, dl->ino[i])) {
+                        resolve_entry(dl, i); // dir-ness decides how to delete
+                        job->items[job->n].type = dl->type[i];
+                        strcpy(job->items[job->n].name, ent_name(dl, i));
+                        ++job->n;
+                        mark_remove(g_dir_dev, dl->ino[i]);
+                    }
+                }
+
+                atomic_store(&g_del_files, 0);
+                atomic_store(&g_del_done, 0);
+                g_del_total = job->n;
+                clock_gettime(CLOCK_MONOTONIC, &g_del_start);
+                atomic_store(&g_del_active, true);
+
+                pthread_t thread;
+                if (pthread_create(&thread, NULL, delete_worker, job) != 0) {
+                    free(job->items);
+                    free(job);
+                    atomic_store(&g_del_active, false);
+                    break;
+                }
+                pthread_detach(thread);
 
-    bool a_is_dir = a->type == TYPE_DIR || a->type == TYPE_SYML_TO_DIR;
-    bool b_is_dir = b->type == TYPE_DIR || b->type == TYPE_SYML_TO_DIR;
+                dirty = true;
+                break;
+            }
+            }
+        }
 
-    if (a_is_dir != b_is_dir) {
-        return a_is_dir ? -1 : 1;
+        if (dirty) {
+            redraw(dl, g_user_and_hostname, path, sel, sel - y);
+        }
     }
 
-    return strcmp(a->name, b->name);
-}
-
-/**
- * Sets the terminal size on g_row
- */
-static bool
-get_term_size(void)
-{
-    struct winsize wsize;
-    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &wsize) < 0) {
-        perror("ioctl");
-        return false;
+quit:
+    while (nav_n > 0) {
+        close(nav_stack[--nav_n]);
     }
-
-    g_row = wsize.ws_row;
-    g_col = wsize.ws_col;
-
-    return true;
+    free(nav_stack);
 }
 
-/**
- * Used as SIGWINCH (terminal resize handler)
- */
-static void
-handle_winch(int sig)
-{
-    signal(sig, SIG_IGN);
-    get_term_size();
-    signal(sig, handle_winch);
-}
+static int g_attach_sock = -1; // attached client's socket, for SIGWINCH
 
 /**
- * Resets the terminal to it's prior state
+ * SIGWINCH while attached: the daemon can't see our terminal's signals,
+ * so forward the resize as a byte on the socket. Installed without
+ * SA_RESTART so the blocking read below wakes up to send it
  */
 static void
-restore_terminal(void)
+client_winch(int sig)
 {
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &g_old_termios) < 0) {
-        perror("tcsetattr");
+    (void)sig;
+    if (g_attach_sock >= 0) {
+        ssize_t ignored = write(g_attach_sock, "w", 1);
+        (void)ignored;
     }
-
-    printf(
-        "\033[?7h"    // enable line wrapping
-        "\033[?25h"   // unhide cursor
-        "\033[;r"     // reset scroll region
-        "\033[?1049l" // restore main screen
-    );
 }
 
 /**
- * Sets up the terminal for TUI use (read every char, differentiate \r and \n,
- * don't echo, hide the cursor, fix a scroll region, switch to a second screen)
+ * Tries to hand this invocation to a running daemon: send the start
+ * directory and our terminal, block until the session ends, then write
+ * the quit state the daemon handed back. Returns false when no daemon is
+ * listening, so startup falls through to the standalone path
  */
 static bool
-setup_terminal(void)
+client_attach(const char *path)
 {
-    setvbuf(stdout, NULL, _IOFBF, 0);
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    filet_socket_path(addr.sun_path, sizeof(addr.sun_path));
 
-    if (tcgetattr(STDIN_FILENO, &g_old_termios) < 0) {
-        perror("tcgetattr");
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
         return false;
     }
 
-    struct termios raw = g_old_termios;
-    raw.c_oflag &= ~OPOST;
-    raw.c_lflag &= ~(ECHO | ICANON);
+    // the start dir in the payload, the terminal in the ancillary data
+    struct iovec iov = {
+        .iov_base = (void *)path,
+        .iov_len  = strlen(path) + 1,
+    };
+    char cbuf[CMSG_SPACE(sizeof(int))] = {0};
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = cbuf,
+        .msg_controllen = sizeof(cbuf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level     = SOL_SOCKET;
+    cmsg->cmsg_type      = SCM_RIGHTS;
+    cmsg->cmsg_len       = CMSG_LEN(sizeof(int));
+    int tty              = STDIN_FILENO;
+    memcpy(CMSG_DATA(cmsg), &tty, sizeof(int));
 
-    if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) < 0) {
-        perror("tcsetattr");
+    if (sendmsg(fd, &msg, 0) < 0) {
+        close(fd);
         return false;
     }
 
-    printf(
-        "\033[?1049h" // use alternative screen buffer
-        "\033[?7l"    // diable line wrapping
-        "\033[?25l"   // hide cursor
-        "\033[2J"     // clear screen
-        "\033[3;%dr", // limit scrolling to scrolling area
-        g_row);
+    g_attach_sock       = fd;
+    struct sigaction sa = {.sa_handler = client_winch};
+    sigaction(SIGWINCH, &sa, NULL);
+
+    // two NUL-terminated strings come back when the session ends
+    char reply[sizeof(g_quit_dir) + sizeof(g_quit_sel)];
+    size_t len = 0;
+    for (;;) {
+        ssize_t r = read(fd, reply + len, sizeof(reply) - 1 - len);
+        if (r < 0 && errno == EINTR) {
+            continue; // the handler already poked the daemon
+        }
+        if (r <= 0) {
+            break;
+        }
+        len += (size_t)r;
+    }
+    close(fd);
+    g_attach_sock = -1;
+
+    reply[len] = '\0';
+    if (len > 0) {
+        strcpy(g_quit_dir, reply);
+        const char *quit_sel = reply + strlen(reply) + 1;
+        if (quit_sel < reply + len) {
+            strcpy(g_quit_sel, quit_sel);
+        }
+        write_quit_state();
+    }
 
     return true;
 }
 
 /**
- * Read a directory into ents.
- *
- * Returns the number of elements in the dir.
+ * Receives a client's start directory and terminal fd. Returns the tty
+ * fd, or -1 on a malformed hello
  */
-static size_t
-read_dir(
-    const char *path,
-    struct direlement **ents,
-    size_t *ents_size,
-    bool show_hidden)
+static int
+session_recv(int cfd, char *path)
 {
-    size_t n = 0;
-    DIR *dir;
-    dir = opendir(path);
-    if (dir) {
-        struct dirent *ent;
-        while ((ent = readdir(dir))) {
-            const char *name = ent->d_name;
-            int fd           = dirfd(dir);
-            struct stat sb;
-
-            if (name[0] == '.' &&
-                (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
-                continue;
-            }
-
-            if (!show_hidden && name[0] == '.') {
-                continue;
-            }
+    struct iovec iov = {.iov_base = path, .iov_len = PATH_MAX - 1};
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = cbuf,
+        .msg_controllen = sizeof(cbuf),
+    };
 
-            if (fstatat(fd, name, &sb, AT_SYMLINK_NOFOLLOW) < 0) {
-                continue;
-            }
-
-            if (n == *ents_size) {
-                *ents_size += ENT_ALLOC_NUM;
-                struct direlement *tmp =
-                    realloc(*ents, *ents_size * sizeof(*tmp));
-                if (!tmp) {
-                    perror("realloc");
-                    exit(EXIT_FAILURE);
-                }
-                *ents = tmp;
-            }
-
-            strcpy((*ents)[n].name, ent->d_name);
-            (*ents)[n].is_selected = false;
-
-            if (S_ISDIR(sb.st_mode)) {
-                (*ents)[n].type = TYPE_DIR;
-            } else if (S_ISLNK(sb.st_mode)) {
-                if (!(fstatat(dirfd(dir), (*ents)[n].name, &sb, 0) < 0 ||
-                      !S_ISDIR(sb.st_mode))) {
-                    (*ents)[n].type = TYPE_SYML_TO_DIR;
-                } else {
-                    (*ents)[n].type = TYPE_SYML;
-                }
-            } else {
-                if (sb.st_mode & S_IXUSR) {
-                    (*ents)[n].type = TYPE_EXEC;
-                } else {
-                    (*ents)[n].type = TYPE_NORM;
-                }
-            }
+    ssize_t r = recvmsg(cfd, &msg, 0);
+    if (r <= 0) {
+        return -1;
+    }
+    path[r] = '\0'; // the hello is NUL-terminated already; make sure
 
-            ++n;
-        }
-        qsort(*ents, n, sizeof(**ents), direlemcmp);
-        closedir(dir);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS) {
+        return -1;
     }
 
-    return n;
+    int tty;
+    memcpy(&tty, CMSG_DATA(cmsg), sizeof(int));
+    return tty;
 }
 
 /**
- * Spawns a new process, waits for it and returns
+ * The daemon proper: accept a client, adopt its terminal, run the
+ * session, hand the quit state back, park the terminal again. Never
+ * returns; kill the daemon to drop the cache
  */
 static void
-spawn(const char *path, const char *cmd, const char *argv1)
+filet_daemon(void)
 {
-    int status;
-    pid_t pid = fork();
+    signal(SIGPIPE, SIG_IGN); // a vanishing client mustn't kill the cache
 
-    if (pid < 0) {
-        return;
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    filet_socket_path(addr.sun_path, sizeof(addr.sun_path));
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    unlink(addr.sun_path); // a stale socket from a dead daemon
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+    if (listen(lfd, 1) < 0) {
+        perror("listen");
+        exit(EXIT_FAILURE);
     }
 
-    restore_terminal();
-    fflush(stdout);
+    make_user_and_hostname();
+    fprintf(stderr, "filet: daemon listening on %s\n", addr.sun_path);
 
-    if (pid == 0) {
-        if (chdir(path) < 0) {
-            _exit(EXIT_FAILURE);
-        }
-        execlp(cmd, cmd, argv1, NULL);
-        // NOTREACHED
-        _exit(EXIT_FAILURE);
-    } else {
-        do {
-            waitpid(pid, &status, WUNTRACED);
-        } while (!WIFEXITED(status) && !WIFSIGNALED(status));
+    char *path = malloc(PATH_MAX);
+    if (!path) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
     }
 
-    setup_terminal();
-}
+    for (;;) {
+        int cfd = accept(lfd, NULL, NULL);
+        if (cfd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("accept");
+            exit(EXIT_FAILURE);
+        }
 
-/**
- * Draws a single directory entry in it's own line
- *
- * Assumes the cursor is at the beginning of the line
- */
-static void
-draw_line(const struct direlement *ent, bool is_sel)
-{
-    switch (ent->type) {
-    case TYPE_DIR:
-        printf("\033[34;1m");
-        break;
-    case TYPE_SYML: // FALLTHROUGH
-    case TYPE_SYML_TO_DIR:
-        printf("\033[36;1m");
-        break;
-    case TYPE_EXEC:
-        printf("\033[32;1m");
-        break;
-    case TYPE_NORM:
-        printf("\033[0m");
-        break;
-    }
+        int tty = session_recv(cfd, path);
+        if (tty < 0) {
+            close(cfd);
+            continue;
+        }
 
-    if (is_sel) {
-        printf("> %c%s", ent->is_selected ? '*' : ' ', ent->name);
-    } else {
-        printf(
-            " %c%s ",
-            ent->is_selected ? '*' : ' ',
-            ent->name); // space to clear the last char on unindenting it
-    }
-}
+        // adopt the client's terminal for the length of the session
+        dup2(tty, STDIN_FILENO);
+        dup2(tty, STDOUT_FILENO);
+        close(tty);
 
-/**
- * Redraws the whole screen. Avoid this if possible
- */
-static void
-redraw(
-    const struct direlement *ents,
-    const char *user_and_hostname,
-    const char *path,
-    size_t n,
-    size_t sel,
-    size_t offset)
-{
-    // clear screen and redraw status
-    printf(
-        "\033[2J"       // clear screen
-        "\033[H"        // go to 0,0
-        "%s"            // print username@hostname
-        "\033[34;1m%s"  // print path
-        " \033[0m[%zu]" // number of entries
-        "\r\n",         // enter scrolling region
-        user_and_hostname,
-        path,
-        n);
+        if (!get_term_size() || !setup_terminal()) {
+            close(cfd);
+            continue;
+        }
 
-    if (n == 0) {
-        printf("\n\033[31;7mdirectory empty\033[27m");
-    } else {
-        for (size_t i = offset; i < n && i - offset < (size_t)g_row - 2; ++i) {
-            printf("\n");
-            draw_line(&ents[i], i == sel);
-            printf("\r");
+        g_session_sock = cfd;
+        run_session(path);
+        g_session_sock = -1;
+        restore_terminal();
+
+        if (g_quit_dir[0] != '\0') {
+            ssize_t ignored;
+            ignored = write(cfd, g_quit_dir, strlen(g_quit_dir) + 1);
+            ignored = write(cfd, g_quit_sel, strlen(g_quit_sel) + 1);
+            (void)ignored;
         }
-    }
+        close(cfd);
 
-    // move cursor to selection
-    printf("\033[3H");
+        // park the std fds so nothing scribbles on a terminal we gave back
+        int nul = open("/dev/null", O_RDWR);
+        if (nul >= 0) {
+            dup2(nul, STDIN_FILENO);
+            dup2(nul, STDOUT_FILENO);
+            close(nul);
+        }
+    }
 }
 
 int
 main(int argc, char **argv)
 {
-    if (!(isatty(STDIN_FILENO) && isatty(STDOUT_FILENO))) {
-        fprintf(stderr, "isatty: not connected to a tty");
-        exit(EXIT_FAILURE);
+    bool daemon_mode = false;
+    if (argc > 1 && strcmp(argv[1], "-d") == 0) {
+        daemon_mode = true;
+        --argc;
+        ++argv;
     }
 
     char *path = malloc(PATH_MAX);
@@ -372,29 +5795,32 @@ main(int argc, char **argv)
         }
     }
 
-    const char *editor = getenv_or("EDITOR", "vi");
-    const char *shell  = getenv_or("SHELL", "/bin/sh");
-    const char *home   = getenv_or("HOME", "/");
-    const char *user   = getlogin();
+    colors_init(); // must precede the first read_dir
 
-    char *hostname = malloc(HOST_NAME_MAX);
-    if (!hostname) {
-        perror("malloc");
+    g_inotify_fd = inotify_init1(IN_NONBLOCK);
+
+    if (pipe(g_wake_pipe) < 0) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
     }
+    fcntl(g_wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(g_wake_pipe[1], F_SETFL, O_NONBLOCK);
 
-    if (gethostname(hostname, HOST_NAME_MAX) < 0) {
-        perror("gethostname");
-        free(hostname);
-        hostname = NULL;
+    if (daemon_mode) {
+        filet_daemon(); // never returns
     }
 
-    size_t ents_size        = ENT_ALLOC_NUM;
-    struct direlement *ents = malloc(ents_size * sizeof(*ents));
-    if (!ents) {
-        perror("malloc");
+    if (!(isatty(STDIN_FILENO) && isatty(STDOUT_FILENO))) {
+        fprintf(stderr, "isatty: not connected to a tty");
         exit(EXIT_FAILURE);
     }
 
+    if (client_attach(path)) {
+        return EXIT_SUCCESS; // a daemon ran the session for us
+    }
+
+    make_user_and_hostname();
+
     if (!get_term_size()) {
         exit(EXIT_FAILURE);
     }
@@ -408,189 +5834,16 @@ main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
+    INSTR_INIT(); // registered first so it dumps after terminal restore
     atexit(restore_terminal);
 
-    char *user_and_hostname = malloc(
-        strlen(user) + strlen(hostname) + strlen("\033[32;1m@\033[0m:") + 1);
-    if (!user_and_hostname) {
-        perror("malloc");
-        exit(EXIT_FAILURE);
-    }
-
-    strcpy(user_and_hostname, "\033[32;1m");
-    strcat(user_and_hostname, user);
-    strcat(user_and_hostname, "@");
-    strcat(user_and_hostname, hostname);
-    strcat(user_and_hostname, "\033[0m:");
-
-    bool show_hidden = false;
-    bool fetch_dir   = true;
-    size_t sel       = 0;
-    size_t y         = 0;
-    size_t n;
-
-    for (;;) {
-        if (fetch_dir) {
-            fetch_dir = false;
-            sel       = 0;
-            y         = 0;
-            n         = read_dir(path, &ents, &ents_size, show_hidden);
-
-            redraw(ents, user_and_hostname, path, n, sel, 0);
-        }
-
-        fflush(stdout);
-
-        int c = getchar();
-
-        switch (c) {
-        case 'h':
-            dirname(path);
-            fetch_dir = true;
-            break;
-        case '~':
-            strcpy(path, home);
-            fetch_dir = true;
-            break;
-        case '/':
-            strcpy(path, "/");
-            fetch_dir = true;
-            break;
-        case '.':
-            show_hidden = !show_hidden;
-            fetch_dir   = true;
-            break;
-        case 'r':
-            fetch_dir = true;
-            break;
-        case 's':
-            spawn(path, shell, NULL);
-            fetch_dir = true;
-            break;
-        case 'q': {
-            FILE *f = fopen("/tmp/filet_dir", "w");
-            if (f) {
-                fprintf(f, "%s\n", path);
-            }
-            f = fopen("/tmp/filet_sel", "w");
-            if (f) {
-                fprintf(f, "%s/%s\n", path, ents[sel].name);
-            }
-            exit(EXIT_SUCCESS);
-            break;
-        }
-        }
-
-        if (n == 0) {
-            continue; // rest of the commands requires at least one entry
-        }
-
-        switch (c) {
-        case 'j':
-            if (sel < n - 1) {
-                draw_line(&ents[sel], false);
-                printf("\r\n");
-                ++sel;
-                draw_line(&ents[sel], true);
-                printf("\r");
-
-                if (y < (size_t)g_row - 3) {
-                    ++y;
-                }
-            }
-            break;
-        case 'k':
-            if (sel > 0) {
-                draw_line(&ents[sel], false);
-                if (y == 0) {
-                    printf("\r\033[L");
-                } else {
-                    printf("\r\033[A");
-                    --y;
-                }
-                --sel;
-                draw_line(&ents[sel], true);
-                printf("\r");
-            }
-            break;
-        case 'l':
-            if (ents[sel].type == TYPE_DIR ||
-                ents[sel].type == TYPE_SYML_TO_DIR) {
-                // don't append to /
-                if (path[1] != '\0') {
-                    strcat(path, "/");
-                }
-                strcat(path, ents[sel].name);
-                fetch_dir = true;
-            }
-            break;
-        case 'g':
-            if (sel - y == 0) {
-                draw_line(&ents[sel], false);
-                printf("\033[3H");
-                sel = 0;
-                draw_line(&ents[sel], true);
-                printf("\r");
-            } else {
-                // screen needs to be redrawn
-                sel = 0;
-                y   = 0;
-                redraw(ents, user_and_hostname, path, n, sel, 0);
-            }
-            break;
-        case 'G':
-            if (sel + g_row - 2 - y >= n) {
-                draw_line(&ents[sel], false);
-                printf(
-                    "\033[%luH",
-                    2 + (n < ((size_t)g_row - 3) ? n : (size_t)g_row));
-                sel = n - 1;
-                y   = g_row - 3;
-                draw_line(&ents[sel], true);
-                printf("\r");
-            } else {
-                // screen needs to be redrawn
-                sel = n - 1;
-                y   = g_row - 3;
-                redraw(ents, user_and_hostname, path, n, sel, n - (g_row - 2));
-                printf("\033[%dH", g_row);
-            }
-            break;
-        case 'e':
-            spawn(path, editor, ents[sel].name);
-            fetch_dir = true;
-            break;
-        case 'm':
-            ents[sel].is_selected = !ents[sel].is_selected;
-            draw_line(&ents[sel], true);
-            printf("\r");
-            break;
-        case 'x': {
-            int fd = open(path, 0);
-            if (fd < 0) {
-                continue;
-            }
-            for (size_t i = 0; i < n; ++i) {
-                if (ents[i].is_selected) {
-                    if (ents[i].type == TYPE_DIR) {
-                        nftw(
-                            ents[i].name,
-                            delete_file,
-                            32,
-                            FTW_DEPTH | FTW_MOUNT | FTW_PHYS);
-                    } else {
-                        unlinkat(
-                            fd,
-                            ents[i].name,
-                            ents[i].type == TYPE_DIR ? AT_REMOVEDIR : 0);
-                    }
-                }
+    run_session(path);
 
-                fetch_dir = true;
-            }
-            close(fd);
-            break;
-        }
-        }
+    if (g_quit_dir[0] != '\0') {
+        write_quit_state();
     }
+
+    return EXIT_SUCCESS;
 }
+
+#endif // FILET_BENCH